@@ -35,6 +35,8 @@ static struct dentry *osfs_lookup(struct inode *dir, struct dentry *dentry, unsi
 
     // Traverse the directory entries to find a matching filename
     for (i = 0; i < dir_entry_count; i++) {
+        if (!dir_entries[i].inode_no)
+            continue; // 已刪除的空位
         if (strlen(dir_entries[i].filename) == dentry->d_name.len &&
             strncmp(dir_entries[i].filename, dentry->d_name.name, dentry->d_name.len) == 0) {
             // File found, get inode
@@ -85,6 +87,12 @@ static int osfs_iterate(struct file *filp, struct dir_context *ctx)
         struct osfs_dir_entry *entry = &dir_entries[i];
         unsigned int type = DT_UNKNOWN;
 
+        // 刪除留下的空位也佔一個 pos，其他項目的 pos 不會因刪除而改變
+        if (!entry->inode_no) {
+            ctx->pos++;
+            continue;
+        }
+
         if (!dir_emit(ctx, entry->filename, strlen(entry->filename), entry->inode_no, type)) {
             pr_err("osfs_iterate: dir_emit failed for entry '%s'\n", entry->filename);
             return -EINVAL;
@@ -111,7 +119,7 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
     struct osfs_sb_info *sb_info = sb->s_fs_info;
     struct inode *inode;
     struct osfs_inode *osfs_inode;
-    int ino, ret;
+    int ino;
     struct timespec64 now;
 
     /* Check if the mode is supported */
@@ -132,8 +140,10 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
 
     /* Allocate a new VFS inode */
     inode = new_inode(sb);
-    if (!inode)
+    if (!inode) {
+        osfs_release_inode(sb_info, ino);
         return ERR_PTR(-ENOMEM);
+    }
 
     /* Initialize inode owner and permissions */
     inode_init_owner(&nop_mnt_idmap, inode, dir, mode);
@@ -141,6 +151,7 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
     inode->i_sb = sb;
     inode->i_blocks = 0; // Initialize with 0 blocks
     simple_inode_init_ts(inode);
+    insert_inode_hash(inode); // 之後 osfs_iget 會拿到同一個 inode
 
     /* Set inode operations based on file type */
     if (S_ISDIR(mode)) {
@@ -149,8 +160,7 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
         set_nlink(inode, 2); /* . and .. */
         inode->i_size = 0;
     } else if (S_ISREG(mode)) {
-        inode->i_op = &osfs_file_inode_operations;
-        inode->i_fop = &osfs_file_operations;
+        osfs_init_file_inode(inode);
         set_nlink(inode, 1);
         inode->i_size = 0;
     } else if (S_ISLNK(mode)) {
@@ -162,10 +172,12 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
     osfs_inode = osfs_get_osfs_inode(sb, ino);
     if (!osfs_inode) {
         pr_err("osfs_new_inode: Failed to get osfs_inode for inode %d\n", ino);
+        clear_nlink(inode); // osfs_evict_inode 會把 inode 編號還回去
         iput(inode);
         return ERR_PTR(-EIO);
     }
     memset(osfs_inode, 0, sizeof(*osfs_inode));
+    seqlock_init(&osfs_inode->i_meta_lock);
 
     /* Initialize osfs_inode */
     osfs_inode->i_ino = ino;
@@ -182,25 +194,9 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
     osfs_inode->__i_atime = osfs_inode->__i_mtime = osfs_inode->__i_ctime = now;
     inode->i_private = osfs_inode;
 
-    // BONUS Strategy: 
-    // If it's a DIRECTORY, allocate the first block immediately to store entries.
-    // If it's a FILE, do NOT allocate block yet (Delayed Allocation).
-    if (S_ISDIR(mode)) {
-        if (sb_info->nr_free_blocks == 0) {
-             iput(inode);
-             return ERR_PTR(-ENOSPC);
-        }
-        ret = osfs_alloc_data_block(sb_info, &osfs_inode->i_blocks_array[0]);
-        if (ret) {
-            iput(inode);
-            return ERR_PTR(ret);
-        }
-        osfs_inode->i_blocks = 1;
-        inode->i_blocks = 1;
-    }
-
-    /* Update superblock information */
-    sb_info->nr_free_inodes--;
+    // BONUS Strategy: Delayed Allocation for both files and directories.
+    // A directory gets its entry block from osfs_add_dir_entry when the first
+    // entry arrives, so an empty directory costs only its inode.
 
     /* Mark inode as dirty */
     mark_inode_dirty(inode);
@@ -215,27 +211,34 @@ static int osfs_add_dir_entry(struct inode *dir, uint32_t inode_no, const char *
     void *dir_data_block;
     struct osfs_dir_entry *dir_entries;
     int dir_entry_count;
+    int slot;
     int i;
+    int ret;
 
     // BONUS: Use the first block (Assuming directories only use 1 block for this lab)
+    // 空目錄還沒有區塊：第一個項目進來時才配置
     if (parent_inode->i_blocks == 0) {
-         pr_err("osfs_add_dir_entry: Parent directory has no data block\n");
-         return -EIO;
+        ret = osfs_alloc_data_block(sb_info, &parent_inode->i_blocks_array[0]);
+        if (ret)
+            return ret;
+        parent_inode->i_blocks = 1;
+        dir->i_blocks = 1;
     }
-    
+
     dir_data_block = sb_info->data_blocks + parent_inode->i_blocks_array[0] * BLOCK_SIZE;
 
     // Calculate the existing number of directory entries
     dir_entry_count = parent_inode->i_size / sizeof(struct osfs_dir_entry);
-    if (dir_entry_count >= MAX_DIR_ENTRIES) {
-        pr_err("osfs_add_dir_entry: Parent directory is full\n");
-        return -ENOSPC;
-    }
-
     dir_entries = (struct osfs_dir_entry *)dir_data_block;
 
-    // Check if a file with the same name exists
+    // Check if a file with the same name exists (and remember the first free slot)
+    slot = dir_entry_count;
     for (i = 0; i < dir_entry_count; i++) {
+        if (!dir_entries[i].inode_no) {
+            if (slot == dir_entry_count)
+                slot = i;
+            continue;
+        }
         if (strlen(dir_entries[i].filename) == name_len &&
             strncmp(dir_entries[i].filename, name, name_len) == 0) {
             pr_warn("osfs_add_dir_entry: File '%.*s' already exists\n", (int)name_len, name);
@@ -243,18 +246,99 @@ static int osfs_add_dir_entry(struct inode *dir, uint32_t inode_no, const char *
         }
     }
 
-    // Add a new directory entry
-    strncpy(dir_entries[dir_entry_count].filename, name, name_len);
-    dir_entries[dir_entry_count].filename[name_len] = '\0';
-    dir_entries[dir_entry_count].inode_no = inode_no;
+    // 沒有刪除留下的空位才接在最後面
+    if (slot == dir_entry_count) {
+        if (dir_entry_count >= MAX_DIR_ENTRIES) {
+            pr_err("osfs_add_dir_entry: Parent directory is full\n");
+            return -ENOSPC;
+        }
+        // Update the size of the parent directory
+        parent_inode->i_size += sizeof(struct osfs_dir_entry);
+    }
 
-    // Update the size of the parent directory
-    parent_inode->i_size += sizeof(struct osfs_dir_entry);
+    // Add a new directory entry
+    strncpy(dir_entries[slot].filename, name, name_len);
+    dir_entries[slot].filename[name_len] = '\0';
+    dir_entries[slot].inode_no = inode_no;
 
     return 0;
 }
 
 
+/**
+ * Function: osfs_find_dir_entry
+ * Description: Finds the entry with the given name in a directory.
+ * Returns:
+ *   - A pointer to the entry inside the directory's data block.
+ *   - NULL if no entry has that name.
+ */
+static struct osfs_dir_entry *osfs_find_dir_entry(struct inode *dir, const char *name,
+                                                  size_t name_len)
+{
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
+    struct osfs_inode *parent_inode = dir->i_private;
+    struct osfs_dir_entry *dir_entries;
+    int dir_entry_count;
+    int i;
+
+    if (parent_inode->i_blocks == 0)
+        return NULL;
+
+    dir_entries = (struct osfs_dir_entry *)(sb_info->data_blocks +
+                                            parent_inode->i_blocks_array[0] * BLOCK_SIZE);
+    dir_entry_count = parent_inode->i_size / sizeof(struct osfs_dir_entry);
+
+    for (i = 0; i < dir_entry_count; i++) {
+        if (dir_entries[i].inode_no &&
+            strlen(dir_entries[i].filename) == name_len &&
+            strncmp(dir_entries[i].filename, name, name_len) == 0)
+            return &dir_entries[i];
+    }
+    return NULL;
+}
+
+/**
+ * Function: osfs_remove_dir_entry
+ * Description: Removes the entry with the given name from a directory. The slot
+ *   is cleared in place (inode_no 0) and reused by a later osfs_add_dir_entry,
+ *   so no other entry changes index and a readdir in progress (which resumes
+ *   from an index in ctx->pos) neither skips nor repeats entries. Free slots at
+ *   the end are dropped from i_size, so an empty directory has i_size 0.
+ * Returns:
+ *   - 0 on success.
+ *   - -ENOENT if no entry has that name.
+ */
+static int osfs_remove_dir_entry(struct inode *dir, const char *name, size_t name_len)
+{
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
+    struct osfs_inode *parent_inode = dir->i_private;
+    struct osfs_dir_entry *dir_entries;
+    struct osfs_dir_entry *entry;
+    int dir_entry_count;
+
+    entry = osfs_find_dir_entry(dir, name, name_len);
+    if (!entry)
+        return -ENOENT;
+
+    entry->inode_no = 0;
+    entry->filename[0] = '\0';
+
+    // 尾端的空位直接從 i_size 拿掉
+    dir_entries = (struct osfs_dir_entry *)(sb_info->data_blocks +
+                                            parent_inode->i_blocks_array[0] * BLOCK_SIZE);
+    dir_entry_count = parent_inode->i_size / sizeof(struct osfs_dir_entry);
+    while (dir_entry_count > 0 && !dir_entries[dir_entry_count - 1].inode_no)
+        dir_entry_count--;
+    parent_inode->i_size = dir_entry_count * sizeof(struct osfs_dir_entry);
+
+    // 目錄清空就把區塊還回去 (根目錄的 block 0 等於 OSFS_HOLE，會被跳過、永遠保留)
+    if (parent_inode->i_size == 0) {
+        parent_inode->i_blocks -= osfs_free_data_blocks(sb_info, parent_inode->i_blocks_array, 1);
+        dir->i_blocks = parent_inode->i_blocks;
+    }
+    return 0;
+}
+
 /**
  * Function: osfs_create
  * Description: Creates a new file within a directory.
@@ -263,6 +347,7 @@ static int osfs_create(struct mnt_idmap *idmap, struct inode *dir, struct dentry
 {   
     // Step1: Parse the parent directory passed by the VFS 
     // dir 是父目錄的 VFS inode，我們透過 i_private 取得我們自定義的 osfs_inode
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
     struct osfs_inode *parent_inode = dir->i_private;
     struct osfs_inode *osfs_inode;
     struct inode *inode;
@@ -288,6 +373,7 @@ static int osfs_create(struct mnt_idmap *idmap, struct inode *dir, struct dentry
     osfs_inode = inode->i_private;
     if (!osfs_inode) {
         pr_err("osfs_create: Failed to get osfs_inode for inode %lu\n", inode->i_ino);
+        clear_nlink(inode);
         iput(inode);
         return -EIO;
     }
@@ -299,6 +385,7 @@ static int osfs_create(struct mnt_idmap *idmap, struct inode *dir, struct dentry
     ret = osfs_add_dir_entry(dir, inode->i_ino, dentry->d_name.name, dentry->d_name.len);
     if (ret) {
         pr_err("osfs_create: Failed to add directory entry\n");
+        clear_nlink(inode); // 還沒有任何目錄指向它，釋放 inode 編號
         iput(inode);
         return ret;
     }
@@ -318,6 +405,12 @@ static int osfs_create(struct mnt_idmap *idmap, struct inode *dir, struct dentry
     // 這是 Linux VFS 的關鍵步驟，完成後檔案才算正式存在於 VFS 層。
     d_instantiate(dentry, inode);
 
+    // engine=pagecache: 檔案資料只存在 VFS inode 的 page cache 裡，
+    // 像 ramfs 一樣每個名字 (不分類型) 都多拿一個 dentry reference，inode 才不會連同資料被回收；
+    // 卸載時由 kill_litter_super 一次放掉
+    if (sb_info->engine == OSFS_ENGINE_PAGECACHE)
+        dget(dentry);
+
     pr_info("osfs_create: File '%.*s' created with inode %lu\n",
             (int)dentry->d_name.len, dentry->d_name.name, inode->i_ino);
 
@@ -326,14 +419,378 @@ static int osfs_create(struct mnt_idmap *idmap, struct inode *dir, struct dentry
 
 
 
+/**
+ * Function: osfs_unlink
+ * Description: Removes a name from a directory. The inode and its blocks are
+ *   freed by osfs_evict_inode once the last link is gone and nobody has the
+ *   file open anymore.
+ */
+static int osfs_unlink(struct inode *dir, struct dentry *dentry)
+{
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
+    struct osfs_inode *parent_inode = dir->i_private;
+    struct inode *inode = d_inode(dentry);
+    struct timespec64 now;
+    int ret;
+
+    ret = osfs_remove_dir_entry(dir, dentry->d_name.name, dentry->d_name.len);
+    if (ret)
+        return ret;
+
+    now = current_time(dir);
+    inode_set_mtime_to_ts(dir, now);
+    inode_set_ctime_to_ts(dir, now);
+    dir->i_size = parent_inode->i_size;
+    mark_inode_dirty(dir);
+
+    inode_set_ctime_to_ts(inode, now);
+    drop_nlink(inode);
+    mark_inode_dirty(inode);
+
+    // engine=pagecache: 放掉建立時多拿的 dentry reference
+    if (sb_info->engine == OSFS_ENGINE_PAGECACHE)
+        dput(dentry);
+
+    return 0;
+}
+
+/**
+ * Function: osfs_rmdir
+ * Description: Removes an empty directory. An empty directory holds no block
+ *   (osfs_remove_dir_entry gives it back with the last entry), so only the
+ *   inode is left for osfs_evict_inode to free.
+ */
+static int osfs_rmdir(struct inode *dir, struct dentry *dentry)
+{
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
+    struct osfs_inode *parent_inode = dir->i_private;
+    struct inode *inode = d_inode(dentry);
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct timespec64 now;
+    int ret;
+
+    // 目錄裡不存 . 和 ..，尾端空位也會從 i_size 拿掉，所以 i_size 不是 0 就代表還有東西
+    if (osfs_inode->i_size)
+        return -ENOTEMPTY;
+
+    ret = osfs_remove_dir_entry(dir, dentry->d_name.name, dentry->d_name.len);
+    if (ret)
+        return ret;
+
+    now = current_time(dir);
+    inode_set_mtime_to_ts(dir, now);
+    inode_set_ctime_to_ts(dir, now);
+    dir->i_size = parent_inode->i_size;
+    drop_nlink(dir); // 少了一個子目錄的 ".."
+    mark_inode_dirty(dir);
+
+    inode_set_ctime_to_ts(inode, now);
+    clear_nlink(inode);
+    mark_inode_dirty(inode);
+
+    // engine=pagecache: 放掉 osfs_mkdir 多拿的 dentry reference
+    if (sb_info->engine == OSFS_ENGINE_PAGECACHE)
+        dput(dentry);
+
+    return 0;
+}
+
+/**
+ * Function: osfs_rename
+ * Description: Renames or moves a directory entry. Only entries change: the
+ *   inode and its data blocks are never touched, so the cost does not depend
+ *   on the file size.
+ *   - Same directory, no target: the entry's name is rewritten in place.
+ *   - Existing target: the target's entry is repointed at the source inode
+ *     (atomic replace) and the source entry is removed.
+ *   - RENAME_EXCHANGE: the two entries swap inode numbers.
+ *   - RENAME_NOREPLACE: the VFS has already failed with -EEXIST if the target
+ *     exists, so it takes the no-target path.
+ */
+static int osfs_rename(struct mnt_idmap *idmap, struct inode *old_dir, struct dentry *old_dentry,
+                       struct inode *new_dir, struct dentry *new_dentry, unsigned int flags)
+{
+    struct osfs_sb_info *sb_info = old_dir->i_sb->s_fs_info;
+    struct inode *inode = d_inode(old_dentry);
+    struct inode *target = d_inode(new_dentry);
+    struct osfs_inode *target_osfs_inode;
+    struct osfs_dir_entry *old_entry, *new_entry;
+    bool is_dir = S_ISDIR(inode->i_mode);
+    struct timespec64 now;
+    int ret;
+
+    if (flags & ~(RENAME_NOREPLACE | RENAME_EXCHANGE))
+        return -EINVAL;
+
+    if (new_dentry->d_name.len > MAX_FILENAME_LEN)
+        return -ENAMETOOLONG;
+
+    old_entry = osfs_find_dir_entry(old_dir, old_dentry->d_name.name, old_dentry->d_name.len);
+    if (!old_entry)
+        return -ENOENT;
+
+    if (flags & RENAME_EXCHANGE) {
+        new_entry = osfs_find_dir_entry(new_dir, new_dentry->d_name.name, new_dentry->d_name.len);
+        if (!new_entry)
+            return -ENOENT;
+        swap(old_entry->inode_no, new_entry->inode_no);
+
+        // 跨目錄交換「目錄」和「檔案」時，兩邊父目錄的子目錄數 (nlink) 也要交換
+        if (old_dir != new_dir && is_dir != S_ISDIR(target->i_mode)) {
+            if (is_dir) {
+                drop_nlink(old_dir);
+                inc_nlink(new_dir);
+            } else {
+                inc_nlink(old_dir);
+                drop_nlink(new_dir);
+            }
+        }
+    } else if (target) {
+        target_osfs_inode = target->i_private;
+        if (S_ISDIR(target->i_mode) && target_osfs_inode->i_size)
+            return -ENOTEMPTY;
+
+        new_entry = osfs_find_dir_entry(new_dir, new_dentry->d_name.name, new_dentry->d_name.len);
+        if (!new_entry)
+            return -ENOENT;
+        // 目標項目直接改指到來源 inode：任何時刻看到的都是舊檔或新檔其中之一
+        new_entry->inode_no = inode->i_ino;
+        ret = osfs_remove_dir_entry(old_dir, old_dentry->d_name.name, old_dentry->d_name.len);
+        if (ret)
+            return ret;
+
+        if (S_ISDIR(target->i_mode)) {
+            // 被覆蓋的目錄換成搬進來的目錄：new_dir 的子目錄數不變，
+            // old_dir 則少了一個子目錄 (同目錄時就是兩個子目錄變一個)
+            clear_nlink(target);
+            drop_nlink(old_dir);
+        } else {
+            drop_nlink(target);
+        }
+        // engine=pagecache: 放掉被覆蓋的項目建立時多拿的 dentry reference
+        if (sb_info->engine == OSFS_ENGINE_PAGECACHE)
+            dput(new_dentry);
+    } else if (old_dir == new_dir) {
+        // 同目錄改名：直接改寫原本的目錄項目
+        strncpy(old_entry->filename, new_dentry->d_name.name, new_dentry->d_name.len);
+        old_entry->filename[new_dentry->d_name.len] = '\0';
+    } else {
+        ret = osfs_add_dir_entry(new_dir, inode->i_ino, new_dentry->d_name.name,
+                                 new_dentry->d_name.len);
+        if (ret)
+            return ret;
+        osfs_remove_dir_entry(old_dir, old_dentry->d_name.name, old_dentry->d_name.len);
+        if (is_dir) {
+            drop_nlink(old_dir);
+            inc_nlink(new_dir);
+        }
+    }
+
+    now = current_time(old_dir);
+    inode_set_mtime_to_ts(old_dir, now);
+    inode_set_ctime_to_ts(old_dir, now);
+    old_dir->i_size = ((struct osfs_inode *)old_dir->i_private)->i_size;
+    mark_inode_dirty(old_dir);
+    if (new_dir != old_dir) {
+        inode_set_mtime_to_ts(new_dir, now);
+        inode_set_ctime_to_ts(new_dir, now);
+        new_dir->i_size = ((struct osfs_inode *)new_dir->i_private)->i_size;
+        mark_inode_dirty(new_dir);
+    }
+    inode_set_ctime_to_ts(inode, now);
+    mark_inode_dirty(inode);
+    if (target) {
+        inode_set_ctime_to_ts(target, now);
+        mark_inode_dirty(target);
+    }
+
+    return 0;
+}
+
+/**
+ * Function: osfs_mkdir
+ * Description: Creates a directory: one osfs_add_dir_entry pass over the parent
+ *   inserts the entry, and the parent's nlink gains the new ".." link. The new
+ *   directory gets no data block until its first entry is added.
+ */
+static int osfs_mkdir(struct mnt_idmap *idmap, struct inode *dir,
+                      struct dentry *dentry, umode_t mode)
+{
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
+    struct osfs_inode *parent_inode = dir->i_private;
+    struct inode *inode;
+    struct timespec64 now;
+    int ret;
+
+    if (dentry->d_name.len > MAX_FILENAME_LEN)
+        return -ENAMETOOLONG;
+
+    inode = osfs_new_inode(dir, S_IFDIR | mode);
+    if (IS_ERR(inode))
+        return PTR_ERR(inode);
+
+    ret = osfs_add_dir_entry(dir, inode->i_ino, dentry->d_name.name, dentry->d_name.len);
+    if (ret) {
+        clear_nlink(inode);
+        iput(inode);
+        return ret;
+    }
+
+    now = current_time(dir);
+    inode_set_mtime_to_ts(dir, now);
+    inode_set_ctime_to_ts(dir, now);
+    dir->i_size = parent_inode->i_size;
+    inc_nlink(dir);
+    mark_inode_dirty(dir);
+
+    d_instantiate(dentry, inode);
+    // engine=pagecache: 和 osfs_create 一樣釘住 dentry，kill_litter_super 才能對稱地放掉
+    if (sb_info->engine == OSFS_ENGINE_PAGECACHE)
+        dget(dentry);
+    return 0;
+}
+
+/**
+ * Function: osfs_link
+ * Description: Adds another name (hard link) for an existing inode.
+ */
+static int osfs_link(struct dentry *old_dentry, struct inode *dir, struct dentry *dentry)
+{
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
+    struct osfs_inode *parent_inode = dir->i_private;
+    struct inode *inode = d_inode(old_dentry);
+    struct timespec64 now;
+    int ret;
+
+    if (dentry->d_name.len > MAX_FILENAME_LEN)
+        return -ENAMETOOLONG;
+
+    ret = osfs_add_dir_entry(dir, inode->i_ino, dentry->d_name.name, dentry->d_name.len);
+    if (ret)
+        return ret;
+
+    now = current_time(dir);
+    inode_set_mtime_to_ts(dir, now);
+    inode_set_ctime_to_ts(dir, now);
+    dir->i_size = parent_inode->i_size;
+    mark_inode_dirty(dir);
+
+    inode_set_ctime_to_ts(inode, now);
+    inc_nlink(inode);
+    mark_inode_dirty(inode); // osfs_dirty_inode 會同步 i_links_count
+    ihold(inode);
+    d_instantiate(dentry, inode);
+
+    // engine=pagecache: 和 osfs_create 一樣，每個名字都多拿一個 dentry reference
+    if (sb_info->engine == OSFS_ENGINE_PAGECACHE)
+        dget(dentry);
+
+    return 0;
+}
+
+/**
+ * Function: osfs_symlink
+ * Description: Creates a symbolic link. Targets shorter than
+ *   OSFS_INLINE_LINK_LEN are stored inside the osfs_inode (fast symlink);
+ *   longer ones take one data block. Either way get_link returns the string
+ *   directly (see osfs_init_symlink_inode).
+ */
+static int osfs_symlink(struct mnt_idmap *idmap, struct inode *dir,
+                        struct dentry *dentry, const char *symname)
+{
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
+    struct osfs_inode *parent_inode = dir->i_private;
+    struct osfs_inode *osfs_inode;
+    struct inode *inode;
+    size_t len = strlen(symname);
+    struct timespec64 now;
+    int ret;
+
+    if (dentry->d_name.len > MAX_FILENAME_LEN)
+        return -ENAMETOOLONG;
+    if (len >= BLOCK_SIZE)
+        return -ENAMETOOLONG;
+
+    inode = osfs_new_inode(dir, S_IFLNK | 0777);
+    if (IS_ERR(inode))
+        return PTR_ERR(inode);
+    osfs_inode = inode->i_private;
+
+    if (len < OSFS_INLINE_LINK_LEN) {
+        memcpy(osfs_inode->i_link, symname, len + 1);
+    } else {
+        ret = osfs_alloc_data_block(sb_info, &osfs_inode->i_blocks_array[0]);
+        if (ret)
+            goto out_put;
+        memcpy(sb_info->data_blocks + osfs_inode->i_blocks_array[0] * BLOCK_SIZE,
+               symname, len + 1);
+        osfs_inode->i_blocks = 1;
+        inode->i_blocks = 1;
+    }
+    osfs_inode->i_size = len;
+    inode->i_size = len;
+    osfs_init_symlink_inode(inode);
+
+    ret = osfs_add_dir_entry(dir, inode->i_ino, dentry->d_name.name, dentry->d_name.len);
+    if (ret)
+        goto out_put;
+
+    now = current_time(dir);
+    inode_set_mtime_to_ts(dir, now);
+    inode_set_ctime_to_ts(dir, now);
+    dir->i_size = parent_inode->i_size;
+    mark_inode_dirty(dir);
+
+    d_instantiate(dentry, inode);
+    // engine=pagecache: 和 osfs_create 一樣釘住 dentry
+    if (sb_info->engine == OSFS_ENGINE_PAGECACHE)
+        dget(dentry);
+    return 0;
+
+out_put:
+    clear_nlink(inode); // osfs_evict_inode 會把區塊與 inode 編號還回去
+    iput(inode);
+    return ret;
+}
+
+/**
+ * Function: osfs_tmpfile
+ * Description: O_TMPFILE: creates an unnamed file. No directory entry is added,
+ *   so the parent is not modified; the inode starts with nlink 0 and is freed
+ *   by osfs_evict_inode on last close unless linkat() gives it a name first.
+ */
+static int osfs_tmpfile(struct mnt_idmap *idmap, struct inode *dir,
+                        struct file *file, umode_t mode)
+{
+    struct inode *inode;
+
+    inode = osfs_new_inode(dir, mode);
+    if (IS_ERR(inode))
+        return PTR_ERR(inode);
+
+    // d_tmpfile 把 nlink 降成 0 並標記 I_LINKABLE，之後 osfs_link 可以再幫它取名
+    d_tmpfile(file, inode);
+    return finish_open_simple(file, 0);
+}
+
 const struct inode_operations osfs_dir_inode_operations = {
     .lookup = osfs_lookup,
     .create = osfs_create,
+    .unlink = osfs_unlink,
+    .mkdir = osfs_mkdir,
+    .rmdir = osfs_rmdir,
+    .rename = osfs_rename,
+    .link = osfs_link,
+    .symlink = osfs_symlink,
+    .tmpfile = osfs_tmpfile,
+    .setattr = osfs_setattr,
     // Add other operations as needed
 };
 
 const struct file_operations osfs_dir_operations = {
     .iterate_shared = osfs_iterate,
     .llseek = generic_file_llseek,
+    .unlocked_ioctl = osfs_dir_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
     // Add other operations as needed
 };
\ No newline at end of file
@@ -1,180 +1,1208 @@
+#include <linux/falloc.h>
 #include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/pfn_t.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
 #include <linux/uaccess.h>
 #include "osfs.h"
 
 /**
- * Function: osfs_read
+ * Function: osfs_read_iter
  * Description: Reads data from a file, supporting multiple blocks (Bonus).
+ *   Holes read as zeros without allocating anything.
+ *   The inode lock is held shared from the block lookup until the copy is
+ *   done, so truncate, hole punching and zero-write elision cannot free a
+ *   block (and the allocator hand it to another file) under the copy. With
+ *   IOCB_NOWAIT the lock is only tried.
  */
 // 原始：直接去抓 i_block，然後 copy_to_user。
 // Bonus: 迴圈邏輯：計算 logical_block_index (目前讀到第幾塊)、查表 i_blocks_array[index]找實體區塊、支援跨區塊連續讀取。
-static ssize_t osfs_read(struct file *filp, char __user *buf, size_t len, loff_t *ppos)
+// read_iter: 改用 iov_iter，readv / preadv2 / io_uring 的多段 buffer 一次處理完。
+static ssize_t osfs_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
-    struct inode *inode = file_inode(filp);
+    struct inode *inode = file_inode(iocb->ki_filp);
     struct osfs_inode *osfs_inode = inode->i_private;
     struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
     void *data_block;
     ssize_t bytes_read = 0;
+    size_t len = iov_iter_count(to);
     size_t chunk_len;
+    size_t copied;
     uint32_t logical_block_index;
     uint32_t physical_block_no;
     size_t offset_in_block;
 
-    if (*ppos >= osfs_inode->i_size)
-        return 0;
+    if (iocb->ki_flags & IOCB_NOWAIT) {
+        if (!inode_trylock_shared(inode))
+            return -EAGAIN;
+    } else {
+        inode_lock_shared(inode);
+    }
 
-    if (*ppos + len > osfs_inode->i_size)
-        len = osfs_inode->i_size - *ppos;
+    if (iocb->ki_pos >= osfs_inode->i_size)
+        goto out_unlock;
+
+    if (iocb->ki_pos + len > osfs_inode->i_size)
+        len = osfs_inode->i_size - iocb->ki_pos;
 
     // Bonus 才有迴圈，因檔案可能大於4KB
     while (len > 0) {
-        logical_block_index = *ppos / BLOCK_SIZE;
-        offset_in_block = *ppos % BLOCK_SIZE;
+        logical_block_index = iocb->ki_pos / BLOCK_SIZE;
+        offset_in_block = iocb->ki_pos % BLOCK_SIZE;
         chunk_len = BLOCK_SIZE - offset_in_block;
         if (chunk_len > len) //大於len 下一輪再做
             chunk_len = len;
 
-        // Check if we have a valid block for this logical index
-        if (logical_block_index >= osfs_inode->i_blocks) {
-            // Reading past allocated blocks (shouldn't happen if i_size is correct)
-            break;
-        }
-
         // 原版: physical = osfs_inode->i_block
         // Bonus: 從陣列查表 physical = osfs_inode->i_blocks_array[index]
-        physical_block_no = osfs_inode->i_blocks_array[logical_block_index];
-        // 計算記憶體位址並複製給使用者
-        data_block = sb_info->data_blocks + physical_block_no * BLOCK_SIZE + offset_in_block;
-
-        if (copy_to_user(buf, data_block, chunk_len)) {
-            return -EFAULT;
+        physical_block_no = READ_ONCE(osfs_inode->i_blocks_array[logical_block_index]);
+        if (physical_block_no == OSFS_HOLE) {
+            // Sparse file: 沒有配置區塊的範圍直接補 0 給使用者
+            copied = iov_iter_zero(chunk_len, to);
+        } else {
+            // 計算記憶體位址並複製給使用者
+            data_block = sb_info->data_blocks + physical_block_no * BLOCK_SIZE + offset_in_block;
+            copied = copy_to_iter(data_block, chunk_len, to);
         }
+        iocb->ki_pos += copied;
+        len -= copied;
+        bytes_read += copied;
 
-        buf += chunk_len;
-        *ppos += chunk_len;
-        len -= chunk_len;
-        bytes_read += chunk_len;
+        if (copied < chunk_len) {
+            if (bytes_read == 0)
+                bytes_read = -EFAULT;
+            break;
+        }
     }
 
+out_unlock:
+    inode_unlock_shared(inode);
     return bytes_read;
 }
 
 
+// osfs_map_block flags
+#define OSFS_MAP_NOWAIT 0x1 // IOCB_NOWAIT: never switch blocks (that may sleep)
+#define OSFS_MAP_LOCKED 0x2 // The caller holds the mapping's invalidate_lock
+
 /**
- * Function: osfs_write
+ * Function: osfs_map_block
+ * Description: Looks up the physical block behind a logical block of a file for
+ *   writing: fills a hole with a new zeroed block, and breaks sharing
+ *   (copy-on-write) if the block is shared with a reflinked file.
+ *   *blocks_delta counts the blocks the caller added to the file; it is
+ *   published together with the size and timestamps by osfs_publish_write.
+ *   An exclusive block is written in place without the invalidate_lock. When
+ *   the slot has to switch blocks, the switch and the unmap of the old block
+ *   happen under the invalidate_lock (taken here unless OSFS_MAP_LOCKED), so
+ *   osfs_mmap_fault cannot map the old block again in between. With
+ *   OSFS_MAP_NOWAIT the block is only used if it can be written in place.
+ * Returns:
+ *   - 0 on success, with *physical_block_no set.
+ *   - -ENOSPC if the block is beyond MAX_EXTENTS or no data block is free.
+ *   - -EAGAIN with OSFS_MAP_NOWAIT if the block would have to be allocated or copied.
+ */
+static int osfs_map_block(struct inode *inode, uint32_t logical_block_index, unsigned int flags,
+                          int *blocks_delta, uint32_t *physical_block_no)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    uint32_t *block_slot;
+    uint32_t old_block;
+    uint32_t goal = 0;
+    bool new_block;
+    int ret;
+
+    // Max file size check
+    if (logical_block_index >= MAX_EXTENTS)
+        return -ENOSPC;
+
+    block_slot = &osfs_inode->i_blocks_array[logical_block_index];
+    old_block = *block_slot;
+
+    // 盡量接在前一個邏輯區塊的實體區塊後面，讓檔案在記憶體中保持連續
+    if (logical_block_index && osfs_inode->i_blocks_array[logical_block_index - 1] != OSFS_HOLE)
+        goal = osfs_inode->i_blocks_array[logical_block_index - 1] + 1;
+
+    // 洞 (hole) 配一個新區塊；與 reflink clone 共用的區塊先複製一份，只改自己的那份。
+    // 沒拿 invalidate lock 時只接受就地寫入 (nowait)，要換區塊再拿鎖重來
+    ret = osfs_prepare_data_block(sb_info, block_slot, goal, !(flags & OSFS_MAP_LOCKED),
+                                  &new_block);
+    if (ret == -EAGAIN && !(flags & OSFS_MAP_NOWAIT)) {
+        filemap_invalidate_lock(inode->i_mapping);
+        ret = osfs_map_block(inode, logical_block_index, flags | OSFS_MAP_LOCKED,
+                             blocks_delta, physical_block_no);
+        filemap_invalidate_unlock(inode->i_mapping);
+        return ret;
+    }
+    if (ret)
+        return ret;
+    if (new_block)
+        (*blocks_delta)++;
+
+    *physical_block_no = *block_slot;
+    // 換了區塊：既有 mmap 可能還映射著 zero page 或舊的共用區塊，拆掉讓它重新 fault
+    if (*physical_block_no != old_block)
+        unmap_mapping_range(inode->i_mapping,
+                            (loff_t)logical_block_index * BLOCK_SIZE, BLOCK_SIZE, 0);
+    return 0;
+}
+
+/**
+ * Function: osfs_free_blocks
+ * Description: Turns the logical blocks [first, last) of a file into holes and
+ *   drops their references through osfs_free_data_blocks. The caller holds the
+ *   inode lock and the mapping's invalidate_lock and has already unmapped the
+ *   range. Returns the change in the file's block count (zero or negative).
+ */
+static int osfs_free_blocks(struct inode *inode, uint32_t first, uint32_t last)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+
+    last = min_t(uint32_t, last, MAX_EXTENTS);
+    if (first >= last)
+        return 0;
+
+    return -(int)osfs_free_data_blocks(sb_info, &osfs_inode->i_blocks_array[first],
+                                       last - first);
+}
+
+/**
+ * Function: osfs_publish_write
+ * Description: Publishes the block count, size and timestamps after data was
+ *   written to a file. Everything is updated inside one seqlock section, so
+ *   osfs_getattr never sees a half-applied combination. Blocks allocated before
+ *   a failure are published too, so they are not leaked.
+ */
+static void osfs_publish_write(struct inode *inode, int blocks_delta,
+                               loff_t end_pos, bool modified)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct timespec64 now = current_time(inode);
+
+    write_seqlock(&osfs_inode->i_meta_lock);
+    osfs_inode->i_blocks += blocks_delta;
+    inode->i_blocks = osfs_inode->i_blocks; // Update VFS inode blocks count (in 512B units typically, but here simplified)
+
+    // 如果寫入後的位置超過了原本的檔案大小，就要更新檔案大小 (i_size)
+    if (end_pos > osfs_inode->i_size) {
+        osfs_inode->i_size = end_pos;
+        inode->i_size = end_pos;
+    }
+
+    // Update timestamps
+    if (modified) {
+        inode_set_mtime_to_ts(inode, now);
+        inode_set_ctime_to_ts(inode, now);
+        osfs_inode->__i_mtime = now;
+        osfs_inode->__i_ctime = now;
+    }
+    write_sequnlock(&osfs_inode->i_meta_lock);
+
+    mark_inode_dirty(inode);
+}
+
+/**
+ * Function: osfs_write_iter
  * Description: Writes data to a file, allocating multiple blocks as needed (Bonus).
+ *   A whole block is written under the invalidate_lock with the block unmapped
+ *   from every mmap: the data is copied straight into the (exclusive) block,
+ *   which is then turned back into a hole if it is all zeros, or, with the
+ *   "dedup" mount option, shared with an identical block if one exists.
+ *   Writers are serialized on the inode lock. With IOCB_NOWAIT the lock is only
+ *   tried, blocks are only written in place, and the zero/dedup passes (which
+ *   may sleep) are skipped; -EAGAIN is returned instead of sleeping.
  */
 // 原始：若無 Block 則分配、若寫入超過 4KB 則回傳錯誤或截斷、寫入單一 Block
 // Bonus: 迴圈邏輯 (Loop) + 動態分配
 //1. 計算目前寫入位置需要第幾個 Block (index)
 //2. 如果該 index 還沒分配，呼叫 osfs_alloc_data_block 動態新增
 //3. 支援跨區塊連續寫入 (直到 MAX_EXTENTS)
-static ssize_t osfs_write(struct file *filp, const char __user *buf, size_t len, loff_t *ppos)
+static ssize_t osfs_write_iter(struct kiocb *iocb, struct iov_iter *from)
 {   
     //Step1: Retrieve the inode and filesystem information
-    struct inode *inode = file_inode(filp); // VFS inode
+    struct inode *inode = file_inode(iocb->ki_filp); // VFS inode
     struct osfs_inode *osfs_inode = inode->i_private;
     struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
     void *data_block;
     ssize_t bytes_written = 0;
-    int ret;
-    struct timespec64 now;
+    ssize_t ret;
 
+    size_t len;
     size_t chunk_len;
+    size_t copied;
     uint32_t logical_block_index;
     uint32_t physical_block_no;
     size_t offset_in_block;
+    int blocks_delta = 0;
+    bool nowait = iocb->ki_flags & IOCB_NOWAIT;
+    bool full_block;
+
+    if (nowait) {
+        if (!inode_trylock(inode))
+            return -EAGAIN;
+    } else {
+        inode_lock(inode);
+    }
+
+    // 處理 O_APPEND (ki_pos 移到檔尾) 與 RLIMIT_FSIZE 等檢查
+    ret = generic_write_checks(iocb, from);
+    if (ret <= 0)
+        goto out_unlock;
+    len = ret;
+
+    // 清掉 setuid/setgid 並更新 mtime/ctime；NOWAIT 下需要睡眠時回傳 -EAGAIN
+    ret = kiocb_modified(iocb);
+    if (ret)
+        goto out_unlock;
 
     // Bonus才有迴圈
     // Loop to handle writes that span multiple blocks
     while (len > 0) {
-        // 計算目前寫入位置 (*ppos) 對應的是第幾個邏輯區塊 (0, 1, 2, 3, 4...)
-        logical_block_index = *ppos / BLOCK_SIZE;
+        // 計算目前寫入位置 (ki_pos) 對應的是第幾個邏輯區塊 (0, 1, 2, 3, 4...)
+        logical_block_index = iocb->ki_pos / BLOCK_SIZE;
         // 計算在該區塊內的偏移量 (0 ~ 4095)
-        offset_in_block = *ppos % BLOCK_SIZE;
-        
-        // Max file size check
-        if (logical_block_index >= MAX_EXTENTS) {
-            if (bytes_written > 0) break; // Return what we wrote so far
-            return -ENOSPC;
-        }
-
-        // Step2: Check if a data block has been allocated; if not, allocate one
-        // Allocate new blocks if needed
-        // If we need block N, and current i_blocks is N, we need to allocate.
-        // Assumes sequential filling.
-        if (logical_block_index >= osfs_inode->i_blocks) {
-            ret = osfs_alloc_data_block(sb_info, &physical_block_no);
-            if (ret) {
-                 if (bytes_written > 0) break;
-                 return ret;
-            }
-            // 將申請到的實體區塊號碼存入陣列中 (建立索引)
-            osfs_inode->i_blocks_array[logical_block_index] = physical_block_no;
-            osfs_inode->i_blocks++;
-            inode->i_blocks++; // Update VFS inode blocks count (in 512B units typically, but here simplified)
-        } else {
-            // 如果已經分配過，直接從陣列查表取得實體區塊號碼
-            physical_block_no = osfs_inode->i_blocks_array[logical_block_index];
-        }
+        offset_in_block = iocb->ki_pos % BLOCK_SIZE;
 
-        // Step 3: Limit the write length to fit within one data block
+        // Step 2: Limit the write length to fit within one data block
         // 計算這個區塊還剩下多少空間可以寫
         // 例如：BlockSize是4096，已經寫了4000，那這輪只能再寫96 bytes
         chunk_len = BLOCK_SIZE - offset_in_block; // 多的下輪迴圈再寫
         if (chunk_len > len)
             chunk_len = len;
 
+        // 整塊寫入：在 invalidate lock 內先拆掉 mmap，再直接寫進獨佔的區塊，
+        // 寫完檢查是否全 0 / dedup，期間沒有 mmap 能改動這個區塊
+        // (NOWAIT 跳過：invalidate lock 可能睡眠)
+        full_block = !nowait && chunk_len == BLOCK_SIZE;
+        if (full_block) {
+            filemap_invalidate_lock(inode->i_mapping);
+            unmap_mapping_range(inode->i_mapping,
+                                (loff_t)logical_block_index * BLOCK_SIZE, BLOCK_SIZE, 0);
+        }
+
+        // Step 3: Check if a data block has been allocated; if not, allocate one
+        // (可以寫在檔尾之後的任何位置，中間沒寫到的部分留成 hole)
+        // 新增的區塊數先記在 blocks_delta，寫完才一次發布到 osfs_inode (見 Step 5)
+        ret = osfs_map_block(inode, logical_block_index,
+                             nowait ? OSFS_MAP_NOWAIT : full_block ? OSFS_MAP_LOCKED : 0,
+                             &blocks_delta, &physical_block_no);
+        if (ret) {
+            if (full_block)
+                filemap_invalidate_unlock(inode->i_mapping);
+            break;
+        }
+
         // Step 4: Write data from user space to the data block
         // 計算實際記憶體位址：
         // 起始位址 (data_blocks) + 偏移幾個區塊 (physical_block_no * 4096) + 區塊內偏移
         data_block = sb_info->data_blocks + physical_block_no * BLOCK_SIZE + offset_in_block;
         
-        // 使用 copy_from_user 將資料從使用者空間 (buf) 複製到核心空間 (data_block)
-        if (copy_from_user(data_block, buf, chunk_len)) {
-            return -EFAULT;
+        // 使用 copy_from_iter 將資料從使用者空間 (iov_iter) 複製到核心空間 (data_block)
+        // 持有 invalidate lock 時不能在這裡處理 page fault (來源可能是同一個檔案的 mmap)，
+        // 複製不完就放掉鎖、把來源 fault 進來，剩下的下一輪再寫
+        if (full_block) {
+            pagefault_disable();
+            copied = copy_from_iter(data_block, chunk_len, from);
+            pagefault_enable();
+
+            if (copied == BLOCK_SIZE && !memchr_inv(data_block, 0, BLOCK_SIZE)) {
+                // 整個區塊都寫成 0：不必佔一個區塊，改回 hole (memchr_inv 一次比對一個 word)
+                blocks_delta += osfs_free_blocks(inode, logical_block_index,
+                                                 logical_block_index + 1);
+            } else if (sb_info->dedup && copied == BLOCK_SIZE) {
+                // dedup: 內容相同的區塊已存在就改成共用它，否則登記到 hash table。
+                // mmap 已經拆掉：登記過的區塊要寫必須重新 fault 走 copy-on-write
+                osfs_dedup_data_block(sb_info, &osfs_inode->i_blocks_array[logical_block_index]);
+            }
+            filemap_invalidate_unlock(inode->i_mapping);
+        } else {
+            copied = copy_from_iter(data_block, chunk_len, from);
         }
+        iocb->ki_pos += copied;
+        len -= copied;
+        bytes_written += copied;
 
-        buf += chunk_len;
-        *ppos += chunk_len;
-        len -= chunk_len;
-        bytes_written += chunk_len;
+        if (copied < chunk_len) {
+            if (full_block &&
+                fault_in_iov_iter_readable(from, chunk_len - copied) != chunk_len - copied)
+                continue;
+            ret = -EFAULT;
+            break;
+        }
     }
 
     // Step 5: Update inode & osfs_inode attribute
-    // 如果寫入後的位置 (*ppos) 超過了原本的檔案大小，就要更新檔案大小 (i_size)
-    if (*ppos > osfs_inode->i_size) {
-        osfs_inode->i_size = *ppos;
-        inode->i_size = *ppos;
+    // 區塊數、檔案大小與時間戳記在同一個 seqlock 區段內一起更新
+    osfs_publish_write(inode, blocks_delta, iocb->ki_pos, bytes_written > 0);
+
+    // Step 6: Return the number of bytes written
+    if (bytes_written > 0)
+        ret = bytes_written;
+out_unlock:
+    inode_unlock(inode);
+    return ret;
+}
+
+/**
+ * Function: osfs_copy_file_range
+ * Description: Copies a byte range between two osfs files entirely in the
+ *   kernel, block to block. When source and destination sit at the same offset
+ *   within their blocks, physically contiguous runs on both sides are merged
+ *   into one extent and moved with a single memcpy. A hole copied onto a hole
+ *   stays a hole.
+ */
+static ssize_t osfs_copy_file_range(struct file *file_in, loff_t pos_in,
+                                    struct file *file_out, loff_t pos_out,
+                                    size_t len, unsigned int flags)
+{
+    struct inode *inode_in = file_inode(file_in);
+    struct inode *inode_out = file_inode(file_out);
+    struct osfs_inode *osfs_in = inode_in->i_private;
+    struct osfs_inode *osfs_out = inode_out->i_private;
+    struct osfs_sb_info *sb_info = inode_out->i_sb->s_fs_info;
+    ssize_t bytes_copied = 0;
+    ssize_t ret = 0;
+    size_t chunk_len;
+    uint32_t in_index, out_index;
+    size_t in_offset, out_offset;
+    uint32_t in_block, out_block;
+    uint32_t next_out_block;
+    uint32_t extent_blocks;
+    int blocks_delta = 0;
+
+    // 不同的 osfs mount 各有自己的資料區，交給 VFS 的 splice fallback
+    if (inode_in->i_sb != inode_out->i_sb)
+        return -EXDEV;
+
+    lock_two_nondirectories(inode_in, inode_out);
+
+    ret = file_modified(file_out);
+    if (ret)
+        goto out_unlock;
+
+    if (pos_in + len > osfs_in->i_size)
+        len = pos_in < osfs_in->i_size ? osfs_in->i_size - pos_in : 0;
+
+    while (len > 0) {
+        in_index = pos_in / BLOCK_SIZE;
+        in_offset = pos_in % BLOCK_SIZE;
+        out_index = pos_out / BLOCK_SIZE;
+        out_offset = pos_out % BLOCK_SIZE;
+
+        if (out_index >= MAX_EXTENTS) {
+            ret = -ENOSPC;
+            break;
+        }
+
+        in_block = osfs_in->i_blocks_array[in_index];
+        chunk_len = min3(BLOCK_SIZE - in_offset, BLOCK_SIZE - out_offset, len);
+
+        // 來源與目的都是 hole：不用配置也不用複製
+        if (in_block == OSFS_HOLE && osfs_out->i_blocks_array[out_index] == OSFS_HOLE)
+            goto next;
+
+        ret = osfs_map_block(inode_out, out_index, 0, &blocks_delta, &out_block);
+        if (ret)
+            break;
+
+        if (in_block == OSFS_HOLE) {
+            memset(sb_info->data_blocks + out_block * BLOCK_SIZE + out_offset, 0, chunk_len);
+            goto next;
+        }
+
+        // 偏移相同時，把兩邊實體上都連續的區塊併成一個 extent 一次複製
+        if (in_offset == out_offset) {
+            for (extent_blocks = 1; chunk_len < len; extent_blocks++) {
+                if (in_index + extent_blocks >= MAX_EXTENTS ||
+                    osfs_in->i_blocks_array[in_index + extent_blocks] != in_block + extent_blocks)
+                    break;
+                if (osfs_map_block(inode_out, out_index + extent_blocks, 0,
+                                   &blocks_delta, &next_out_block) ||
+                    next_out_block != out_block + extent_blocks)
+                    break;
+                chunk_len = min_t(size_t, chunk_len + BLOCK_SIZE, len);
+            }
+        }
+
+        memcpy(sb_info->data_blocks + out_block * BLOCK_SIZE + out_offset,
+               sb_info->data_blocks + in_block * BLOCK_SIZE + in_offset,
+               chunk_len);
+next:
+        pos_in += chunk_len;
+        pos_out += chunk_len;
+        len -= chunk_len;
+        bytes_copied += chunk_len;
     }
 
-    // Update timestamps
-    now = current_time(inode);
-    inode_set_mtime_to_ts(inode, now);
-    inode_set_ctime_to_ts(inode, now);
-    
-    osfs_inode->__i_mtime = now;
-    osfs_inode->__i_ctime = now;
-    
+    osfs_publish_write(inode_out, blocks_delta, pos_out, bytes_copied > 0);
+
+    if (bytes_copied > 0)
+        ret = bytes_copied;
+out_unlock:
+    unlock_two_nondirectories(inode_in, inode_out);
+    return ret;
+}
+
+/**
+ * Function: osfs_remap_file_range
+ * Description: FICLONE / FICLONERANGE: makes the destination range share the
+ *   source's data blocks instead of copying them. Each shared block gains a
+ *   reference; osfs_write_iter and shared-writable mmaps copy a block only when
+ *   they are about to modify it. Cost is per block, independent of the data.
+ *   Holes in the source become holes in the destination.
+ *   Deduplication (FIDEDUPERANGE) is not supported.
+ */
+static loff_t osfs_remap_file_range(struct file *file_in, loff_t pos_in,
+                                    struct file *file_out, loff_t pos_out,
+                                    loff_t len, unsigned int remap_flags)
+{
+    struct inode *inode_in = file_inode(file_in);
+    struct inode *inode_out = file_inode(file_out);
+    struct osfs_inode *osfs_in = inode_in->i_private;
+    struct osfs_inode *osfs_out = inode_out->i_private;
+    struct osfs_sb_info *sb_info = inode_out->i_sb->s_fs_info;
+    uint32_t in_index, out_index, end_index;
+    uint32_t in_block, old_block;
+    int blocks_delta = 0;
+    loff_t ret;
+
+    if (remap_flags & ~REMAP_FILE_CAN_SHORTEN)
+        return -EOPNOTSUPP;
+
+    lock_two_nondirectories(inode_in, inode_out);
+
+    // 檢查區塊對齊、len == 0 代表到檔尾、同檔案範圍不可重疊，並更新 mtime
+    ret = generic_remap_file_range_prep(file_in, pos_in, file_out, pos_out,
+                                        &len, remap_flags);
+    if (ret < 0 || len == 0)
+        goto out_unlock;
+
+    in_index = pos_in / BLOCK_SIZE;
+    out_index = pos_out / BLOCK_SIZE;
+    end_index = DIV_ROUND_UP(pos_in + len, BLOCK_SIZE);
+
+    if (out_index + (end_index - in_index) > MAX_EXTENTS) {
+        ret = -EFBIG;
+        goto out_unlock;
+    }
+
+    // 既有的 mmap 可能還握著可寫的 PTE，先拆掉，之後的 fault 會走 copy-on-write。
+    // 拆 mmap、改 slot、釋放舊區塊都在 invalidate lock 之內，fault 不會把舊區塊再映射回去
+    filemap_invalidate_lock_two(inode_in->i_mapping, inode_out->i_mapping);
+    unmap_mapping_range(inode_in->i_mapping, pos_in, len, 0);
+    unmap_mapping_range(inode_out->i_mapping, pos_out, len, 0);
+
+    for (; in_index < end_index; in_index++, out_index++) {
+        in_block = osfs_in->i_blocks_array[in_index];
+        old_block = osfs_out->i_blocks_array[out_index];
+
+        if (in_block != OSFS_HOLE) {
+            osfs_get_data_block(sb_info, in_block);
+            blocks_delta++;
+        }
+        WRITE_ONCE(osfs_out->i_blocks_array[out_index], in_block);
+        if (old_block != OSFS_HOLE) {
+            osfs_free_data_block(sb_info, old_block);
+            blocks_delta--;
+        }
+    }
+    filemap_invalidate_unlock_two(inode_in->i_mapping, inode_out->i_mapping);
+
+    osfs_publish_write(inode_out, blocks_delta, pos_out + len, true);
+    ret = len;
+out_unlock:
+    unlock_two_nondirectories(inode_in, inode_out);
+    return ret;
+}
+
+/**
+ * Function: osfs_zero_block_range
+ * Description: Zeroes the bytes [pos, pos + len) of a file, which must lie inside
+ *   one block. A hole needs nothing; a block shared with a reflink clone is
+ *   copied first, so the clone keeps its data.
+ */
+static int osfs_zero_block_range(struct inode *inode, loff_t pos, size_t len)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    uint32_t logical_block_index = pos / BLOCK_SIZE;
+    size_t offset_in_block = pos % BLOCK_SIZE;
+    uint32_t *block_slot;
+    uint32_t old_block;
+    bool new_block;
+    int ret;
+
+    if (!len || logical_block_index >= MAX_EXTENTS)
+        return 0;
+
+    block_slot = &osfs_inode->i_blocks_array[logical_block_index];
+    old_block = *block_slot;
+    if (old_block == OSFS_HOLE)
+        return 0;
+
+    ret = osfs_prepare_data_block(sb_info, block_slot, 0, false, &new_block);
+    if (ret)
+        return ret;
+    if (*block_slot != old_block)
+        unmap_mapping_range(inode->i_mapping, pos - offset_in_block, BLOCK_SIZE, 0);
+
+    memset(sb_info->data_blocks + *block_slot * BLOCK_SIZE + offset_in_block, 0, len);
+    return 0;
+}
+
+/**
+ * Function: osfs_falloc_prealloc
+ * Description: fallocate mode 0: fills every hole in the block range with a
+ *   zeroed block, placed right after the previous block where possible, so later
+ *   writes find their blocks already mapped. Existing blocks are left alone.
+ */
+static int osfs_falloc_prealloc(struct inode *inode, uint32_t first, uint32_t last,
+                                int *blocks_delta)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+    uint32_t logical_block_index;
+    uint32_t physical_block_no;
+    int ret;
+
+    for (logical_block_index = first; logical_block_index < last; logical_block_index++) {
+        if (osfs_inode->i_blocks_array[logical_block_index] != OSFS_HOLE)
+            continue;
+        ret = osfs_map_block(inode, logical_block_index, OSFS_MAP_LOCKED, blocks_delta,
+                             &physical_block_no);
+        if (ret)
+            return ret;
+    }
+    return 0;
+}
+
+/**
+ * Function: osfs_falloc_punch
+ * Description: PUNCH_HOLE / ZERO_RANGE: zeroes the partial blocks at either end
+ *   of the range and gives every whole block inside it back to the bitmap, so
+ *   the range reads as zeros without holding any memory.
+ */
+static int osfs_falloc_punch(struct inode *inode, loff_t offset, loff_t end,
+                             int *blocks_delta)
+{
+    uint32_t first = DIV_ROUND_UP(offset, BLOCK_SIZE);
+    uint32_t last = end / BLOCK_SIZE;
+    int ret;
+
+    if (offset % BLOCK_SIZE) {
+        ret = osfs_zero_block_range(inode, offset,
+                                    min(end, round_up(offset, BLOCK_SIZE)) - offset);
+        if (ret)
+            return ret;
+    }
+    // 尾端不完整的區塊 (若和開頭不是同一塊)
+    if ((end % BLOCK_SIZE) && last >= first) {
+        ret = osfs_zero_block_range(inode, round_down(end, BLOCK_SIZE), end % BLOCK_SIZE);
+        if (ret)
+            return ret;
+    }
+
+    if (first < last) {
+        unmap_mapping_range(inode->i_mapping, (loff_t)first * BLOCK_SIZE,
+                            (loff_t)(last - first) * BLOCK_SIZE, 0);
+        *blocks_delta += osfs_free_blocks(inode, first, last);
+    }
+    return 0;
+}
+
+/**
+ * Function: osfs_falloc_collapse
+ * Description: COLLAPSE_RANGE: frees the blocks [first, last) and moves every
+ *   later block-map entry down to close the gap. Data is never copied.
+ */
+static void osfs_falloc_collapse(struct inode *inode, uint32_t first, uint32_t last,
+                                 int *blocks_delta)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+    uint32_t logical_block_index;
+
+    *blocks_delta += osfs_free_blocks(inode, first, last);
+
+    for (logical_block_index = first; logical_block_index < MAX_EXTENTS; logical_block_index++) {
+        if (logical_block_index + (last - first) < MAX_EXTENTS)
+            WRITE_ONCE(osfs_inode->i_blocks_array[logical_block_index],
+                       osfs_inode->i_blocks_array[logical_block_index + (last - first)]);
+        else
+            WRITE_ONCE(osfs_inode->i_blocks_array[logical_block_index], OSFS_HOLE);
+    }
+}
+
+/**
+ * Function: osfs_falloc_insert
+ * Description: INSERT_RANGE: moves the block-map entries from first onwards up by
+ *   count and leaves a hole of count blocks at first. Data is never copied.
+ *   Blocks pushed past MAX_EXTENTS can only be preallocated blocks beyond EOF
+ *   (the caller checked the new size), and are freed.
+ */
+static void osfs_falloc_insert(struct inode *inode, uint32_t first, uint32_t count,
+                               int *blocks_delta)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+    uint32_t logical_block_index;
+
+    *blocks_delta += osfs_free_blocks(inode, MAX_EXTENTS - count, MAX_EXTENTS);
+
+    for (logical_block_index = MAX_EXTENTS - 1;
+         logical_block_index >= first + count; logical_block_index--)
+        WRITE_ONCE(osfs_inode->i_blocks_array[logical_block_index],
+                   osfs_inode->i_blocks_array[logical_block_index - count]);
+    for (logical_block_index = first; logical_block_index < first + count; logical_block_index++)
+        WRITE_ONCE(osfs_inode->i_blocks_array[logical_block_index], OSFS_HOLE);
+}
+
+/**
+ * Function: osfs_fallocate
+ * Description: fallocate(2) for the bitmap engine.
+ *   - mode 0 (optionally KEEP_SIZE): preallocates blocks.
+ *   - PUNCH_HOLE / ZERO_RANGE: frees the blocks in the range.
+ *   - COLLAPSE_RANGE / INSERT_RANGE: shifts the block map; the range must be
+ *     block aligned and inside the file.
+ *   Holds the mapping's invalidate_lock so mmap faults cannot race the change.
+ */
+static long osfs_fallocate(struct file *file, int mode, loff_t offset, loff_t len)
+{
+    struct inode *inode = file_inode(file);
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct address_space *mapping = inode->i_mapping;
+    loff_t end = offset + len;
+    loff_t new_size;
+    int blocks_delta = 0;
+    long ret;
+
+    if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE |
+                 FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_INSERT_RANGE))
+        return -EOPNOTSUPP;
+
+    inode_lock(inode);
+    new_size = inode->i_size;
+
+    if (mode & (FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_INSERT_RANGE)) {
+        // 只能搬整個區塊，而且範圍必須在檔案之內
+        if (!IS_ALIGNED(offset | len, BLOCK_SIZE) || offset >= new_size ||
+            ((mode & FALLOC_FL_COLLAPSE_RANGE) && end >= new_size)) {
+            ret = -EINVAL;
+            goto out_unlock;
+        }
+        if ((mode & FALLOC_FL_INSERT_RANGE) && new_size + len > inode->i_sb->s_maxbytes) {
+            ret = -EFBIG;
+            goto out_unlock;
+        }
+    }
+
+    ret = file_modified(file);
+    if (ret)
+        goto out_unlock;
+
+    filemap_invalidate_lock(mapping);
+
+    if (mode & FALLOC_FL_COLLAPSE_RANGE) {
+        // 之後的內容都會往前移，整段 mmap 拆掉重新 fault
+        unmap_mapping_range(mapping, offset, 0, 1);
+        osfs_falloc_collapse(inode, offset / BLOCK_SIZE, end / BLOCK_SIZE, &blocks_delta);
+        new_size -= len;
+    } else if (mode & FALLOC_FL_INSERT_RANGE) {
+        unmap_mapping_range(mapping, offset, 0, 1);
+        osfs_falloc_insert(inode, offset / BLOCK_SIZE, len / BLOCK_SIZE, &blocks_delta);
+        new_size += len;
+    } else {
+        if (mode & (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE))
+            ret = osfs_falloc_punch(inode, offset, end, &blocks_delta);
+        else
+            ret = osfs_falloc_prealloc(inode, offset / BLOCK_SIZE,
+                                       DIV_ROUND_UP(end, BLOCK_SIZE), &blocks_delta);
+        // PUNCH_HOLE 一定帶 KEEP_SIZE；其餘模式沒帶就把檔案延伸到 end
+        if (!ret && !(mode & FALLOC_FL_KEEP_SIZE) && end > new_size)
+            new_size = end;
+    }
+
+    // 失敗時已經配置或釋放的區塊也要算進去
+    write_seqlock(&osfs_inode->i_meta_lock);
+    osfs_inode->i_blocks += blocks_delta;
+    inode->i_blocks = osfs_inode->i_blocks;
+    osfs_inode->i_size = new_size;
+    i_size_write(inode, new_size);
+    osfs_inode->__i_mtime = inode_get_mtime(inode);
+    osfs_inode->__i_ctime = inode_get_ctime(inode);
+    write_sequnlock(&osfs_inode->i_meta_lock);
     mark_inode_dirty(inode);
 
-    // Step 6: Return the number of bytes written
-    return bytes_written;
+    filemap_invalidate_unlock(mapping);
+out_unlock:
+    inode_unlock(inode);
+    return ret;
+}
+
+/**
+ * Function: osfs_llseek
+ * Description: Adds SEEK_DATA / SEEK_HOLE on top of the generic llseek, found by
+ *   walking the block map. The region past EOF counts as a hole.
+ */
+static loff_t osfs_llseek(struct file *filp, loff_t offset, int whence)
+{
+    struct inode *inode = file_inode(filp);
+    struct osfs_inode *osfs_inode = inode->i_private;
+    uint32_t logical_block_index;
+    loff_t size;
+    bool hole;
+
+    if (whence != SEEK_DATA && whence != SEEK_HOLE)
+        return generic_file_llseek(filp, offset, whence);
+
+    inode_lock_shared(inode);
+    size = osfs_inode->i_size;
+    if (offset < 0 || offset >= size) {
+        inode_unlock_shared(inode);
+        return -ENXIO;
+    }
+
+    for (logical_block_index = offset / BLOCK_SIZE;
+         (loff_t)logical_block_index * BLOCK_SIZE < size;
+         logical_block_index++) {
+        hole = osfs_inode->i_blocks_array[logical_block_index] == OSFS_HOLE;
+        if (hole == (whence == SEEK_HOLE))
+            break;
+    }
+    inode_unlock_shared(inode);
+
+    offset = max_t(loff_t, offset, (loff_t)logical_block_index * BLOCK_SIZE);
+    if (offset >= size) {
+        // 找不到資料就是 ENXIO；找洞找到檔尾則停在 EOF (檔尾之後視為洞)
+        if (whence == SEEK_DATA)
+            return -ENXIO;
+        offset = size;
+    }
+
+    return vfs_setpos(filp, offset, inode->i_sb->s_maxbytes);
+}
+
+/**
+ * Function: osfs_file_open
+ * Description: Opens a regular file and advertises non-blocking I/O support,
+ *   so io_uring issues reads and writes inline instead of punting to a worker.
+ */
+static int osfs_file_open(struct inode *inode, struct file *filp)
+{
+    filp->f_mode |= FMODE_NOWAIT | FMODE_BUF_RASYNC | FMODE_BUF_WASYNC;
+    return generic_file_open(inode, filp);
+}
+
+/**
+ * Function: osfs_getattr
+ * Description: Fills in file attributes without blocking on concurrent writers.
+ *   Size, block count and mtime/ctime are read from the osfs_inode under its
+ *   metadata seqlock and retried if a write published new values meanwhile.
+ */
+static int osfs_getattr(struct mnt_idmap *idmap, const struct path *path,
+                        struct kstat *stat, u32 request_mask, unsigned int query_flags)
+{
+    struct inode *inode = d_inode(path->dentry);
+    struct osfs_inode *osfs_inode = inode->i_private;
+    unsigned int seq;
+
+    generic_fillattr(idmap, request_mask, inode, stat);
+
+    do {
+        seq = read_seqbegin(&osfs_inode->i_meta_lock);
+        stat->size = osfs_inode->i_size;
+        stat->blocks = osfs_inode->i_blocks;
+        stat->mtime = osfs_inode->__i_mtime;
+        stat->ctime = osfs_inode->__i_ctime;
+    } while (read_seqretry(&osfs_inode->i_meta_lock, seq));
+
+    return 0;
+}
+
+/**
+ * Function: osfs_splice_read
+ * Description: Splices file data into a pipe without copying: each pipe buffer
+ *   references the data-block page itself, so sendfile() to a socket sends
+ *   straight from the block. Holes are spliced as the shared zero page.
+ *   The inode lock is held shared until each page has its pipe reference, so
+ *   a block cannot be freed between the lookup and get_page; once referenced,
+ *   osfs_find_idle_block keeps it from being reused.
+ */
+static ssize_t osfs_splice_read(struct file *in, loff_t *ppos,
+                                struct pipe_inode_info *pipe, size_t len,
+                                unsigned int flags)
+{
+    struct inode *inode = file_inode(in);
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    ssize_t bytes_spliced = 0;
+    ssize_t ret;
+    size_t chunk_len;
+    uint32_t logical_block_index;
+    size_t offset_in_block;
+    uint32_t physical_block_no;
+
+    inode_lock_shared(inode);
+    if (*ppos >= osfs_inode->i_size)
+        goto out_unlock;
+
+    if (*ppos + len > osfs_inode->i_size)
+        len = osfs_inode->i_size - *ppos;
+
+    while (len > 0) {
+        struct pipe_buffer buf = { .ops = &nosteal_pipe_buf_ops };
+
+        logical_block_index = *ppos / BLOCK_SIZE;
+        offset_in_block = *ppos % BLOCK_SIZE;
+        chunk_len = BLOCK_SIZE - offset_in_block;
+        if (chunk_len > len)
+            chunk_len = len;
+
+        physical_block_no = READ_ONCE(osfs_inode->i_blocks_array[logical_block_index]);
+
+        // pipe buffer 直接指向資料區塊的 page，拿一個 reference 給 pipe
+        if (physical_block_no == OSFS_HOLE)
+            buf.page = ZERO_PAGE(0);
+        else
+            buf.page = vmalloc_to_page(sb_info->data_blocks + physical_block_no * BLOCK_SIZE);
+        buf.offset = offset_in_block;
+        buf.len = chunk_len;
+        get_page(buf.page);
+
+        // Pipe full (-EAGAIN) or no readers (-EPIPE): add_to_pipe drops the page ref
+        ret = add_to_pipe(pipe, &buf);
+        if (ret < 0) {
+            if (bytes_spliced == 0)
+                bytes_spliced = ret;
+            break;
+        }
+
+        *ppos += ret;
+        len -= ret;
+        bytes_spliced += ret;
+    }
+
+out_unlock:
+    inode_unlock_shared(inode);
+    if (bytes_spliced > 0)
+        file_accessed(in);
+    return bytes_spliced;
+}
+
+/**
+ * Function: osfs_mmap_update_time
+ * Description: Updates mtime/ctime for a store through a shared mapping and
+ *   mirrors them into the osfs_inode, where osfs_getattr reads them from.
+ */
+static void osfs_mmap_update_time(struct file *file)
+{
+    struct inode *inode = file_inode(file);
+    struct osfs_inode *osfs_inode = inode->i_private;
+
+    file_update_time(file);
+
+    write_seqlock(&osfs_inode->i_meta_lock);
+    osfs_inode->__i_mtime = inode_get_mtime(inode);
+    osfs_inode->__i_ctime = inode_get_ctime(inode);
+    write_sequnlock(&osfs_inode->i_meta_lock);
+}
+
+/**
+ * Function: osfs_mmap_fault
+ * Description: Maps the data block backing the faulting page directly into the
+ *   user address space (DAX-style), so there is no page-cache copy. Shared
+ *   writable mappings write straight into the block; private mappings get the
+ *   block read-only and are copied on write by the core mm.
+ *   The following blocks of the file that fall inside the vma are mapped in the
+ *   same fault (up to OSFS_FAULT_AROUND_PAGES), so sequential or clustered
+ *   access takes one fault per window instead of one per page.
+ *   In shared mappings that may be written, a hole at the faulting page is
+ *   filled and a block shared with a reflink clone (or a dedup match) is copied
+ *   before it is mapped there; fault-around stops at holes and shared blocks
+ *   instead of allocating or copying blocks nobody touched. The PTEs stay
+ *   read-only (write notify) unless this is a write fault, which updates the
+ *   file times and maps the faulting page writable. Other mappings see holes as
+ *   the shared zero page.
+ */
+static vm_fault_t osfs_mmap_fault(struct vm_fault *vmf)
+{
+    struct vm_area_struct *vma = vmf->vma;
+    struct inode *inode = file_inode(vma->vm_file);
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    pgoff_t logical_block_index = vmf->pgoff;
+    pgoff_t last_block;
+    unsigned long address = vmf->address;
+    uint32_t *block_slot;
+    uint32_t physical_block_no;
+    struct page *page;
+    vm_fault_t ret;
+    bool may_write = (vma->vm_flags & (VM_SHARED | VM_MAYWRITE)) == (VM_SHARED | VM_MAYWRITE);
+    bool write_fault = may_write && (vmf->flags & FAULT_FLAG_WRITE);
+    bool new_block;
+    int i;
+
+    // 寫入 fault 直接映射成可寫，不會再經過 pfn_mkwrite，時間戳記在這裡更新
+    if (write_fault) {
+        sb_start_pagefault(inode->i_sb);
+        osfs_mmap_update_time(vma->vm_file);
+    }
+
+    // 和 truncate 互斥：避免把 truncate 正在釋放的區塊映射出去，或在新 EOF 之後補洞
+    filemap_invalidate_lock_shared(inode->i_mapping);
+
+    // 超過檔案大小，依 mmap 語意回 SIGBUS
+    last_block = DIV_ROUND_UP(osfs_inode->i_size, BLOCK_SIZE);
+    if (logical_block_index >= last_block) {
+        ret = VM_FAULT_SIGBUS;
+        goto out_unlock;
+    }
+
+    for (i = 0; i < OSFS_FAULT_AROUND_PAGES; i++) {
+        block_slot = &osfs_inode->i_blocks_array[logical_block_index];
+
+        if (may_write) {
+            // 預先映射時 (i > 0) 不替 hole 配置、也不複製共用區塊 (nowait 回 -EAGAIN 就停手)，
+            // 只處理真的被 fault 的那一頁
+            if (osfs_prepare_data_block(sb_info, block_slot, 0, i > 0, &new_block)) {
+                if (i == 0) {
+                    ret = VM_FAULT_SIGBUS;
+                    goto out_unlock;
+                }
+                break;
+            }
+            if (new_block) {
+                write_seqlock(&osfs_inode->i_meta_lock);
+                osfs_inode->i_blocks++;
+                inode->i_blocks = osfs_inode->i_blocks;
+                write_sequnlock(&osfs_inode->i_meta_lock);
+            }
+        }
+
+        physical_block_no = READ_ONCE(*block_slot);
+        if (physical_block_no == OSFS_HOLE)
+            page = ZERO_PAGE(0);
+        else
+            page = vmalloc_to_page(sb_info->data_blocks + physical_block_no * BLOCK_SIZE);
+
+        if (i == 0 && write_fault)
+            ret = vmf_insert_mixed_mkwrite(vma, address, page_to_pfn_t(page));
+        else
+            ret = vmf_insert_mixed(vma, address, page_to_pfn_t(page));
+        if (unlikely(ret & VM_FAULT_ERROR)) {
+            // 只有 faulting page 本身失敗才回報錯誤，預先映射的失敗就停手
+            if (i == 0)
+                goto out_unlock;
+            break;
+        }
+
+        address += PAGE_SIZE;
+        if (++logical_block_index >= last_block || address >= vma->vm_end)
+            break;
+    }
+
+    ret = VM_FAULT_NOPAGE;
+out_unlock:
+    filemap_invalidate_unlock_shared(inode->i_mapping);
+    if (write_fault)
+        sb_end_pagefault(inode->i_sb);
+    return ret;
+}
+
+/**
+ * Function: osfs_mmap_pfn_mkwrite
+ * Description: Called on the first store to a page that was mapped read-only
+ *   (read fault or fault-around) in a shared writable mapping. The block behind
+ *   it is already exclusive to this file, so only the times need updating.
+ */
+static vm_fault_t osfs_mmap_pfn_mkwrite(struct vm_fault *vmf)
+{
+    struct inode *inode = file_inode(vmf->vma->vm_file);
+
+    sb_start_pagefault(inode->i_sb);
+    osfs_mmap_update_time(vmf->vma->vm_file);
+    sb_end_pagefault(inode->i_sb);
+    return 0;
+}
+
+/**
+ * Function: osfs_mmap_page_mkwrite
+ * Description: Same as osfs_mmap_pfn_mkwrite, for architectures without special
+ *   PTEs, where vmf_insert_mixed maps the data block pages as normal pages.
+ */
+static vm_fault_t osfs_mmap_page_mkwrite(struct vm_fault *vmf)
+{
+    osfs_mmap_pfn_mkwrite(vmf);
+    // 資料區塊的 page 不屬於任何 address_space：自己鎖好回傳，core mm 才不會當成被 truncate 而重試
+    lock_page(vmf->page);
+    return VM_FAULT_LOCKED;
+}
+
+static const struct vm_operations_struct osfs_vm_ops = {
+    .fault = osfs_mmap_fault,
+    .page_mkwrite = osfs_mmap_page_mkwrite,
+    .pfn_mkwrite = osfs_mmap_pfn_mkwrite,
+};
+
+/**
+ * Function: osfs_mmap
+ * Description: Sets up a mapping of a file whose pages are the data blocks themselves.
+ */
+static int osfs_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    // 每個 block 必須剛好是一個 page 才能直接映射
+    BUILD_BUG_ON(BLOCK_SIZE != PAGE_SIZE);
+
+    file_accessed(filp);
+    vm_flags_set(vma, VM_MIXEDMAP);
+    vma->vm_ops = &osfs_vm_ops;
+    return 0;
 }
 
 /**
  * Struct: osfs_file_operations
  */
 const struct file_operations osfs_file_operations = {
+    .open = osfs_file_open,
+    .read_iter = osfs_read_iter,
+    .write_iter = osfs_write_iter,
+    .mmap = osfs_mmap,
+    .splice_read = osfs_splice_read,
+    .copy_file_range = osfs_copy_file_range,
+    .remap_file_range = osfs_remap_file_range,
+    // iter_file_splice_write 把 pipe pages 包成 bvec 交給 osfs_write_iter，
+    // copy_from_iter 直接從 pipe page 寫進資料區塊，不經過 user space。
+    // SPLICE_F_GIFT 的 page 一樣用複製的：資料區塊是固定的 vmalloc 區域，無法收養外來 page
+    .splice_write = iter_file_splice_write,
+    .llseek = osfs_llseek,
+    .fallocate = osfs_fallocate,
+};
+
+/**
+ * Function: osfs_pagecache_write_iter
+ * Description: Buffered write for the page-cache engine. Data goes through the
+ *   generic page-cache path; the resulting size and timestamps are mirrored into
+ *   the osfs_inode so that getattr keeps reading a consistent snapshot.
+ */
+static ssize_t osfs_pagecache_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    ssize_t ret;
+
+    ret = generic_file_write_iter(iocb, from);
+    if (ret > 0)
+        osfs_sync_inode_meta(file_inode(iocb->ki_filp));
+    return ret;
+}
+
+/**
+ * Struct: osfs_pagecache_file_operations
+ * Description: Regular file operations for engine=pagecache mounts.
+ */
+const struct file_operations osfs_pagecache_file_operations = {
     .open = generic_file_open,
-    .read = osfs_read,
-    .write = osfs_write,
-    .llseek = default_llseek,
+    .read_iter = generic_file_read_iter,
+    .write_iter = osfs_pagecache_write_iter,
+    // mmap 寫入由 filemap_page_mkwrite 呼叫 file_update_time，
+    // 新的 mtime/ctime 經 osfs_dirty_inode 同步到 osfs_inode (getattr 讀的是那份)
+    .mmap = generic_file_mmap,
+    .splice_read = filemap_splice_read,
+    .splice_write = iter_file_splice_write,
+    .fsync = noop_fsync,
+    .llseek = generic_file_llseek,
 };
 
+/**
+ * Function: osfs_truncate_blocks
+ * Description: Changes the size of a bitmap-engine file. Shrinking returns every
+ *   block wholly beyond the new EOF to the bitmap right away and zeroes the rest
+ *   of the last partial block; growing only extends the size (the new range is a
+ *   hole). Called with the inode lock held.
+ */
+static int osfs_truncate_blocks(struct inode *inode, loff_t new_size)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct address_space *mapping = inode->i_mapping;
+    loff_t old_size = inode->i_size;
+    loff_t tail;
+    int blocks_delta = 0;
+    int ret = 0;
+
+    filemap_invalidate_lock(mapping);
+
+    // 縮小時清掉新 EOF 之後的殘留資料；變大時清掉舊 EOF 之後 (可能被 mmap 寫過) 的部分
+    tail = min(old_size, new_size);
+    if (tail % BLOCK_SIZE) {
+        ret = osfs_zero_block_range(inode, tail, BLOCK_SIZE - tail % BLOCK_SIZE);
+        if (ret)
+            goto out_unlock;
+    }
+
+    if (new_size < old_size) {
+        // 先拆掉新 EOF 之後的 mmap，再把整塊都在 EOF 之後的區塊還回 bitmap
+        unmap_mapping_range(mapping, round_up(new_size, BLOCK_SIZE), 0, 1);
+        blocks_delta = osfs_free_blocks(inode, DIV_ROUND_UP(new_size, BLOCK_SIZE), MAX_EXTENTS);
+    }
+
+    write_seqlock(&osfs_inode->i_meta_lock);
+    osfs_inode->i_blocks += blocks_delta;
+    inode->i_blocks = osfs_inode->i_blocks;
+    osfs_inode->i_size = new_size;
+    i_size_write(inode, new_size);
+    write_sequnlock(&osfs_inode->i_meta_lock);
+
+out_unlock:
+    filemap_invalidate_unlock(mapping);
+    return ret;
+}
+
+/**
+ * Function: osfs_setattr
+ * Description: Handles chmod/chown/utimes and size changes (ftruncate, O_TRUNC).
+ *   The new attributes are written back to the osfs_inode, which osfs_iget
+ *   reads them from. Also used by directories and symlinks, whose size the VFS
+ *   never changes through setattr.
+ */
+int osfs_setattr(struct mnt_idmap *idmap, struct dentry *dentry, struct iattr *attr)
+{
+    struct inode *inode = d_inode(dentry);
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    int ret;
+
+    ret = setattr_prepare(idmap, dentry, attr);
+    if (ret)
+        return ret;
+
+    if ((attr->ia_valid & ATTR_SIZE) && attr->ia_size != i_size_read(inode)) {
+        if (sb_info->engine == OSFS_ENGINE_PAGECACHE) {
+            truncate_setsize(inode, attr->ia_size);
+        } else {
+            ret = osfs_truncate_blocks(inode, attr->ia_size);
+            if (ret)
+                return ret;
+        }
+    }
+
+    setattr_copy(idmap, inode, attr);
+
+    write_seqlock(&osfs_inode->i_meta_lock);
+    osfs_inode->i_mode = inode->i_mode;
+    osfs_inode->i_uid = i_uid_read(inode);
+    osfs_inode->i_gid = i_gid_read(inode);
+    osfs_inode->i_size = inode->i_size;
+    osfs_inode->__i_atime = inode_get_atime(inode);
+    osfs_inode->__i_mtime = inode_get_mtime(inode);
+    osfs_inode->__i_ctime = inode_get_ctime(inode);
+    write_sequnlock(&osfs_inode->i_meta_lock);
+
+    mark_inode_dirty(inode);
+    return 0;
+}
+
 /**
  * Struct: osfs_file_inode_operations
  */
 const struct inode_operations osfs_file_inode_operations = {
-    // Add inode operations here
+    .setattr = osfs_setattr,
+    .getattr = osfs_getattr,
 };
\ No newline at end of file
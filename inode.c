@@ -1,5 +1,7 @@
 #include <linux/fs.h>
+#include <linux/pagemap.h>
 #include <linux/uaccess.h>
+#include <linux/xxhash.h>
 #include "osfs.h"
 
 /**
@@ -34,17 +36,37 @@ int osfs_get_free_inode(struct osfs_sb_info *sb_info)
 {
     uint32_t ino;
 
+    spin_lock(&sb_info->inode_bitmap_lock);
     for (ino = 1; ino < sb_info->inode_count; ino++) {
         if (!test_bit(ino, sb_info->inode_bitmap)) {
             set_bit(ino, sb_info->inode_bitmap);
             sb_info->nr_free_inodes--;
+            spin_unlock(&sb_info->inode_bitmap_lock);
             return ino;
         }
     }
+    spin_unlock(&sb_info->inode_bitmap_lock);
     pr_err("osfs_get_free_inode: No free inode available\n");
     return -ENOSPC;
 }
 
+/**
+ * Function: osfs_release_inode
+ * Description: Returns an inode number to the inode bitmap.
+ * Inputs:
+ *   - sb_info: The superblock information of the filesystem.
+ *   - ino: The inode number to release.
+ * Returns:
+ *   - None.
+ */
+void osfs_release_inode(struct osfs_sb_info *sb_info, uint32_t ino)
+{
+    spin_lock(&sb_info->inode_bitmap_lock);
+    if (test_and_clear_bit(ino, sb_info->inode_bitmap))
+        sb_info->nr_free_inodes++;
+    spin_unlock(&sb_info->inode_bitmap_lock);
+}
+
 /**
  * Function: osfs_iget
  * Description: Creates or retrieves a VFS inode from a given inode number.
@@ -65,12 +87,13 @@ struct inode *osfs_iget(struct super_block *sb, unsigned long ino)
     if (!osfs_inode)
         return ERR_PTR(-EFAULT);
 
-    inode = new_inode(sb);
+    // 已經在記憶體中的 inode 直接沿用，同一個檔案 (hard link) 只會有一個 VFS inode
+    inode = iget_locked(sb, ino);
     if (!inode)
         return ERR_PTR(-ENOMEM);
+    if (!(inode->i_state & I_NEW))
+        return inode;
 
-    inode->i_ino = ino;
-    inode->i_sb = sb;
     inode->i_mode = osfs_inode->i_mode;
     i_uid_write(inode, osfs_inode->i_uid);
     i_gid_write(inode, osfs_inode->i_gid);
@@ -82,20 +105,231 @@ struct inode *osfs_iget(struct super_block *sb, unsigned long ino)
     inode_set_ctime_to_ts(inode, osfs_inode->__i_ctime);
     inode->i_size = osfs_inode->i_size;
     inode->i_blocks = osfs_inode->i_blocks;
+    set_nlink(inode, osfs_inode->i_links_count);
     inode->i_private = osfs_inode;
 
     if (S_ISDIR(inode->i_mode)) {
         inode->i_op = &osfs_dir_inode_operations;
         inode->i_fop = &osfs_dir_operations;
     } else if (S_ISREG(inode->i_mode)) {
-        inode->i_op = &osfs_file_inode_operations;
+        osfs_init_file_inode(inode);
+    } else if (S_ISLNK(inode->i_mode)) {
+        osfs_init_symlink_inode(inode);
+    }
+
+    unlock_new_inode(inode);
+    return inode;
+}
+
+/**
+ * Function: osfs_init_file_inode
+ * Description: Wires up the operations of a regular file for the mount's storage engine.
+ * Inputs:
+ *   - inode: The VFS inode of a regular file.
+ * Returns:
+ *   - None.
+ */
+void osfs_init_file_inode(struct inode *inode)
+{
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+
+    inode->i_op = &osfs_file_inode_operations;
+
+    if (sb_info->engine == OSFS_ENGINE_PAGECACHE) {
+        // ramfs 作法：資料放在 page cache，沒有後備儲存，所以不可被回收
+        inode->i_fop = &osfs_pagecache_file_operations;
+        inode->i_mapping->a_ops = &ram_aops;
+        mapping_set_gfp_mask(inode->i_mapping, GFP_HIGHUSER);
+        mapping_set_unevictable(inode->i_mapping);
+    } else {
         inode->i_fop = &osfs_file_operations;
     }
+}
 
-    // Insert the inode into the inode hash
-    insert_inode_hash(inode);
+/**
+ * Function: osfs_inode_is_inline
+ * Description: Tells whether a symlink keeps its target in the osfs_inode
+ *              (i_link) instead of a data block.
+ */
+bool osfs_inode_is_inline(struct inode *inode)
+{
+    return S_ISLNK(inode->i_mode) && inode->i_size < OSFS_INLINE_LINK_LEN;
+}
 
-    return inode;
+/**
+ * Struct: osfs_symlink_inode_operations
+ * Description: simple_symlink_inode_operations plus osfs_setattr, so chown and
+ *   utimes on a symlink (lchown, utimensat with AT_SYMLINK_NOFOLLOW) reach the
+ *   osfs_inode.
+ */
+const struct inode_operations osfs_symlink_inode_operations = {
+    .get_link = simple_get_link,
+    .setattr = osfs_setattr,
+};
+
+/**
+ * Function: osfs_init_symlink_inode
+ * Description: Points i_link at a symlink's target, which is either inline in
+ *              the osfs_inode or in its only data block. Both stay put for the
+ *              life of the mount, so simple_get_link returns the string without
+ *              any lookup.
+ * Inputs:
+ *   - inode: The VFS inode of a symlink whose i_size is the target length.
+ * Returns:
+ *   - None.
+ */
+void osfs_init_symlink_inode(struct inode *inode)
+{
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct osfs_inode *osfs_inode = inode->i_private;
+
+    inode->i_op = &osfs_symlink_inode_operations;
+    if (osfs_inode_is_inline(inode))
+        inode->i_link = osfs_inode->i_link;
+    else
+        inode->i_link = sb_info->data_blocks + osfs_inode->i_blocks_array[0] * BLOCK_SIZE;
+}
+
+/**
+ * Function: osfs_sync_inode_meta
+ * Description: Mirrors size, block count and mtime/ctime of a VFS inode into its
+ *              osfs_inode under the metadata seqlock.
+ * Inputs:
+ *   - inode: The VFS inode whose fields were updated by generic VFS code.
+ * Returns:
+ *   - None.
+ */
+void osfs_sync_inode_meta(struct inode *inode)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+
+    write_seqlock(&osfs_inode->i_meta_lock);
+    osfs_inode->i_size = inode->i_size;
+    osfs_inode->i_blocks = inode->i_blocks;
+    osfs_inode->__i_mtime = inode_get_mtime(inode);
+    osfs_inode->__i_ctime = inode_get_ctime(inode);
+    write_sequnlock(&osfs_inode->i_meta_lock);
+}
+
+/*
+ * Function: osfs_find_idle_block
+ * Description: Returns the first free block at or after start whose page has no
+ *              other users, or block_count if there is none.
+ */
+static unsigned long osfs_find_idle_block(struct osfs_sb_info *sb_info, unsigned long start)
+{
+    unsigned long i;
+
+    for (i = find_next_zero_bit(sb_info->block_bitmap, sb_info->block_count, start);
+         i < sb_info->block_count;
+         i = find_next_zero_bit(sb_info->block_bitmap, sb_info->block_count, i + 1)) {
+        if (page_count(vmalloc_to_page(sb_info->data_blocks + i * BLOCK_SIZE)) == 1)
+            break;
+    }
+    return i;
+}
+
+/*
+ * Function: __osfs_alloc_data_block
+ * Description: Bitmap search behind osfs_alloc_data_block_goal; the caller holds
+ *              sb_info->block_lock.
+ */
+static int __osfs_alloc_data_block(struct osfs_sb_info *sb_info, uint32_t goal, uint32_t *block_no)
+{
+    unsigned long i;
+
+    if (goal >= sb_info->block_count)
+        goal = 0;
+
+    // 先從 goal 往後找，找不到再從頭找 (wrap around)
+    // A freed block whose page is still referenced (e.g. by a pipe buffer from
+    // osfs_splice_read) is skipped, so its old contents are never overwritten
+    // with another file's data while someone can still read them.
+    i = osfs_find_idle_block(sb_info, goal);
+    if (i >= sb_info->block_count)
+        i = osfs_find_idle_block(sb_info, 0);
+
+    if (i < sb_info->block_count) {
+        set_bit(i, sb_info->block_bitmap);
+        sb_info->block_refs[i] = 1;
+        sb_info->nr_free_blocks--;
+        *block_no = i;
+        return 0;
+    }
+    pr_err("osfs_alloc_data_block: No free data block available\n");
+    return -ENOSPC;
+}
+
+/**
+ * Function: osfs_count_idle_blocks
+ * Description: Counts the free blocks that osfs_find_idle_block would hand out.
+ *              A freed block whose page is still pinned (e.g. by a pipe buffer)
+ *              cannot be allocated yet, so it is not reported as free either.
+ * Inputs:
+ *   - sb_info: The superblock information of the filesystem.
+ * Returns:
+ *   - The number of allocatable data blocks.
+ */
+uint32_t osfs_count_idle_blocks(struct osfs_sb_info *sb_info)
+{
+    uint32_t count = 0;
+    unsigned long i;
+
+    spin_lock(&sb_info->block_lock);
+    for (i = osfs_find_idle_block(sb_info, 0); i < sb_info->block_count;
+         i = osfs_find_idle_block(sb_info, i + 1))
+        count++;
+    spin_unlock(&sb_info->block_lock);
+    return count;
+}
+
+/*
+ * Function: __osfs_unhash_block
+ * Description: Takes a block out of the dedup hash table (no-op if it is not
+ *              hashed); the caller holds sb_info->block_lock.
+ */
+static void __osfs_unhash_block(struct osfs_sb_info *sb_info, uint32_t block_no)
+{
+    struct osfs_dedup_entry *entry = &sb_info->dedup_entries[block_no];
+
+    if (!hlist_unhashed(&entry->node))
+        hash_del(&entry->node);
+}
+
+/*
+ * Function: __osfs_put_data_block
+ * Description: Drops one reference to a data block and returns it to the bitmap
+ *              when the last one is gone; the caller holds sb_info->block_lock.
+ */
+static void __osfs_put_data_block(struct osfs_sb_info *sb_info, uint32_t block_no)
+{
+    if (--sb_info->block_refs[block_no])
+        return;
+    __osfs_unhash_block(sb_info, block_no);
+    clear_bit(block_no, sb_info->block_bitmap);
+    sb_info->nr_free_blocks++;
+}
+
+/**
+ * Function: osfs_alloc_data_block_goal
+ * Description: Allocates a free data block, preferring the first free block at
+ *              or after a goal block so that a file's blocks stay contiguous.
+ * Inputs:
+ *   - sb_info: The superblock information of the filesystem.
+ *   - goal: Preferred block number (e.g. right after the file's previous block).
+ *   - block_no: Pointer to store the allocated block number.
+ * Returns:
+ *   - 0 on successful allocation.
+ *   - -ENOSPC if no free data block is available.
+ */
+int osfs_alloc_data_block_goal(struct osfs_sb_info *sb_info, uint32_t goal, uint32_t *block_no)
+{
+    int ret;
+
+    spin_lock(&sb_info->block_lock);
+    ret = __osfs_alloc_data_block(sb_info, goal, block_no);
+    spin_unlock(&sb_info->block_lock);
+    return ret;
 }
 
 /**
@@ -110,22 +344,175 @@ struct inode *osfs_iget(struct super_block *sb, unsigned long ino)
  */
 int osfs_alloc_data_block(struct osfs_sb_info *sb_info, uint32_t *block_no)
 {
+    return osfs_alloc_data_block_goal(sb_info, 0, block_no);
+}
+
+/**
+ * Function: osfs_free_data_block
+ * Description: Releases one file's reference to a data block. The block goes
+ *              back to the bitmap once no file (reflink clone) uses it anymore.
+ * Inputs:
+ *   - sb_info: The superblock information of the filesystem.
+ *   - block_no: The block to release.
+ * Returns:
+ *   - None.
+ */
+void osfs_free_data_block(struct osfs_sb_info *sb_info, uint32_t block_no)
+{
+    spin_lock(&sb_info->block_lock);
+    __osfs_put_data_block(sb_info, block_no);
+    spin_unlock(&sb_info->block_lock);
+}
+
+/**
+ * Function: osfs_free_data_blocks
+ * Description: Turns a run of block-map entries into holes and releases their
+ *              blocks, taking block_lock once for the whole batch instead of
+ *              once per block. Each block goes back to the bitmap (and shows up
+ *              in statfs) as soon as its last reference is dropped.
+ * Inputs:
+ *   - sb_info: The superblock information of the filesystem.
+ *   - block_slots: The first block-map entry (i_blocks_array element).
+ *   - count: Number of entries.
+ * Returns:
+ *   - The number of entries that were mapped (the file's block-count loss).
+ */
+uint32_t osfs_free_data_blocks(struct osfs_sb_info *sb_info, uint32_t *block_slots,
+                               uint32_t count)
+{
+    uint32_t released = 0;
     uint32_t i;
 
-    for (i = 0; i < sb_info->block_count; i++) {
-        if (!test_bit(i, sb_info->block_bitmap)) {
-            set_bit(i, sb_info->block_bitmap);
-            sb_info->nr_free_blocks--;
-            *block_no = i;
-            return 0;
+    spin_lock(&sb_info->block_lock);
+    for (i = 0; i < count; i++) {
+        if (block_slots[i] == OSFS_HOLE)
+            continue;
+        __osfs_put_data_block(sb_info, block_slots[i]);
+        WRITE_ONCE(block_slots[i], OSFS_HOLE);
+        released++;
+    }
+    spin_unlock(&sb_info->block_lock);
+    return released;
+}
+
+/**
+ * Function: osfs_get_data_block
+ * Description: Takes an extra reference to a data block that another file now shares.
+ * Inputs:
+ *   - sb_info: The superblock information of the filesystem.
+ *   - block_no: The shared block.
+ * Returns:
+ *   - None.
+ */
+void osfs_get_data_block(struct osfs_sb_info *sb_info, uint32_t block_no)
+{
+    spin_lock(&sb_info->block_lock);
+    sb_info->block_refs[block_no]++;
+    spin_unlock(&sb_info->block_lock);
+}
+
+/**
+ * Function: osfs_prepare_data_block
+ * Description: Makes a block-map entry safe to write through.
+ *              - A hole gets a freshly allocated, zeroed block.
+ *              - A block shared with another file (reflink) is copied to a
+ *                fresh block, and the shared block loses one reference.
+ *              - An exclusive block is left in place, but taken out of the
+ *                dedup table since its contents are about to change.
+ *              The check and the slot update happen under block_lock, so the
+ *              write path and the mmap fault path cannot both fill or copy the
+ *              same slot.
+ * Inputs:
+ *   - sb_info: The superblock information of the filesystem.
+ *   - block_slot: The file's block-map entry (i_blocks_array element).
+ *   - goal: Preferred block number if a hole has to be filled.
+ *   - nowait: Fail instead of changing the slot, for callers that cannot
+ *     unmap the old block under the invalidate_lock right now (IOCB_NOWAIT,
+ *     lock not held yet, or mmap fault-around).
+ *   - new_block: Set to true if a hole was filled (the file gained a block).
+ * Returns:
+ *   - 0 on success.
+ *   - -ENOSPC if no data block is free.
+ *   - -EAGAIN if nowait is set and the slot is a hole or a shared block.
+ */
+int osfs_prepare_data_block(struct osfs_sb_info *sb_info, uint32_t *block_slot,
+                            uint32_t goal, bool nowait, bool *new_block)
+{
+    uint32_t old_block, block_no;
+    int ret = 0;
+
+    *new_block = false;
+
+    spin_lock(&sb_info->block_lock);
+    old_block = *block_slot;
+    if (nowait && (old_block == OSFS_HOLE || sb_info->block_refs[old_block] > 1)) {
+        ret = -EAGAIN;
+    } else if (old_block == OSFS_HOLE) {
+        ret = __osfs_alloc_data_block(sb_info, goal, &block_no);
+        if (!ret) {
+            memset(sb_info->data_blocks + block_no * BLOCK_SIZE, 0, BLOCK_SIZE);
+            WRITE_ONCE(*block_slot, block_no);
+            *new_block = true;
+        }
+    } else if (sb_info->block_refs[old_block] > 1) {
+        ret = __osfs_alloc_data_block(sb_info, old_block + 1, &block_no);
+        if (!ret) {
+            memcpy(sb_info->data_blocks + block_no * BLOCK_SIZE,
+                   sb_info->data_blocks + old_block * BLOCK_SIZE, BLOCK_SIZE);
+            WRITE_ONCE(*block_slot, block_no);
+            __osfs_put_data_block(sb_info, old_block);
         }
+    } else {
+        __osfs_unhash_block(sb_info, old_block);
     }
-    pr_err("osfs_alloc_data_block: No free data block available\n");
-    return -ENOSPC;
+    spin_unlock(&sb_info->block_lock);
+    return ret;
 }
 
-void osfs_free_data_block(struct osfs_sb_info *sb_info, uint32_t block_no)
+/**
+ * Function: osfs_dedup_data_block
+ * Description: Deduplicates a freshly written full block. If another block with
+ *              the same contents is in the dedup table, the file's slot is
+ *              pointed at it (one more reference) and its own block is released;
+ *              otherwise the block is added to the table. Later writes to a
+ *              shared block copy it first (osfs_prepare_data_block).
+ *              The caller must have unmapped the block from the file's mmaps,
+ *              so no writable PTE can change a hashed block behind our back.
+ * Inputs:
+ *   - sb_info: The superblock information of the filesystem.
+ *   - block_slot: The file's block-map entry of the written block.
+ * Returns:
+ *   - None.
+ */
+void osfs_dedup_data_block(struct osfs_sb_info *sb_info, uint32_t *block_slot)
 {
-    clear_bit(block_no, sb_info->block_bitmap);
-    sb_info->nr_free_blocks++;
-}
\ No newline at end of file
+    uint32_t block_no = *block_slot;
+    void *data = sb_info->data_blocks + block_no * BLOCK_SIZE;
+    struct osfs_dedup_entry *entry;
+    uint32_t match;
+    u64 hash;
+
+    // 雜湊在鎖外算；呼叫端持有 inode lock，這段期間沒有人能改這個區塊
+    hash = xxh64(data, BLOCK_SIZE, 0);
+
+    spin_lock(&sb_info->block_lock);
+    hash_for_each_possible(sb_info->dedup_table, entry, node, hash) {
+        match = entry - sb_info->dedup_entries;
+        // hash 相同還要比對內容，避免碰撞
+        if (entry->hash != hash || match == block_no ||
+            memcmp(sb_info->data_blocks + match * BLOCK_SIZE, data, BLOCK_SIZE))
+            continue;
+        sb_info->block_refs[match]++;
+        WRITE_ONCE(*block_slot, match);
+        __osfs_put_data_block(sb_info, block_no);
+        spin_unlock(&sb_info->block_lock);
+        return;
+    }
+
+    entry = &sb_info->dedup_entries[block_no];
+    if (hlist_unhashed(&entry->node)) {
+        entry->hash = hash;
+        hash_add(sb_info->dedup_table, &entry->node, hash);
+    }
+    spin_unlock(&sb_info->block_lock);
+}
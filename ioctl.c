@@ -0,0 +1,572 @@
+#include <linux/capability.h>
+#include <linux/fs.h>
+#include <linux/fs_struct.h>
+#include <linux/mount.h>
+#include <linux/namei.h>
+#include <linux/sched/signal.h>
+#include <linux/security.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/uio.h>
+#include "osfs.h"
+
+/**
+ * Function: osfs_batch_lock
+ * Description: Takes write access to the mount and the directory lock, in the
+ *   same order as unlink(2) and open(O_CREAT): freeze protection first.
+ */
+static int osfs_batch_lock(struct file *filp)
+{
+    int ret;
+
+    ret = mnt_want_write_file(filp);
+    if (ret)
+        return ret;
+    inode_lock_nested(file_inode(filp), I_MUTEX_PARENT);
+    return 0;
+}
+
+static void osfs_batch_unlock(struct file *filp)
+{
+    inode_unlock(file_inode(filp));
+    mnt_drop_write_file(filp);
+}
+
+/**
+ * Function: osfs_batch_create
+ * Description: OSFS_BATCH_CREATE for one item: creates the file through
+ *   security_path_mknod and vfs_create (permission checks, LSM hooks, fsnotify)
+ *   with the caller's umask applied to the requested mode.
+ *   The directory is locked by the caller.
+ */
+static int osfs_batch_create(struct file *filp, struct dentry *dentry,
+                             const struct osfs_batch_item *item)
+{
+    umode_t mode = item->mode & S_IALLUGO;
+    int ret;
+
+    if (d_really_is_positive(dentry))
+        return -EEXIST;
+
+    // 和 open(O_CREAT) 一樣套用 umask (有 POSIX ACL 時由預設 ACL 決定)
+    if (!IS_POSIXACL(file_inode(filp)))
+        mode &= ~current_umask();
+    ret = security_path_mknod(&filp->f_path, dentry, mode | S_IFREG, 0);
+    if (ret)
+        return ret;
+    return vfs_create(file_mnt_idmap(filp), file_inode(filp), dentry, mode, true);
+}
+
+/**
+ * Function: osfs_batch_write
+ * Description: Writes a created file's initial contents straight from the
+ *   caller's buffer. Runs after the directory lock is dropped, like a write(2)
+ *   after open(O_CREAT): vfs_iter_write takes the file's own freeze protection
+ *   and does the rw_verify_area/LSM checks and fsnotify.
+ */
+static int osfs_batch_write(struct file *filp, struct dentry *dentry,
+                            const struct osfs_batch_item *item)
+{
+    struct path path = { .mnt = filp->f_path.mnt, .dentry = dentry };
+    struct file *file;
+    struct iov_iter iter;
+    loff_t pos = 0;
+    ssize_t written;
+    int ret;
+
+    ret = import_ubuf(ITER_SOURCE, u64_to_user_ptr(item->data), item->data_len, &iter);
+    if (ret)
+        return ret;
+
+    file = dentry_open(&path, O_WRONLY, current_cred());
+    if (IS_ERR(file))
+        return PTR_ERR(file);
+    written = vfs_iter_write(file, &iter, &pos, 0);
+    fput(file);
+
+    if (written < 0)
+        return written;
+    // 檔案已建立，但內容沒寫完 (通常是區塊用完)
+    return written < item->data_len ? -ENOSPC : 0;
+}
+
+/**
+ * Function: osfs_batch_one
+ * Description: Runs the namespace part of one OSFS_IOC_BATCH item. The
+ *   directory is locked by the caller. A created file that still needs its
+ *   data written is handed back in *created (with a reference) for the caller
+ *   to fill once the lock is dropped.
+ * Returns: 0 or a negative errno, which becomes the item's result.
+ */
+static int osfs_batch_one(struct file *filp, struct osfs_batch_item *item, char *name,
+                          struct dentry **created)
+{
+    struct inode *dir = file_inode(filp);
+    struct dentry *dentry;
+    int ret;
+
+    if (item->reserved)
+        return -EINVAL;
+    if (!item->name_len || item->name_len > MAX_FILENAME_LEN)
+        return -ENAMETOOLONG;
+    if (copy_from_user(name, u64_to_user_ptr(item->name), item->name_len))
+        return -EFAULT;
+
+    // lookup_one 會檢查目錄的執行權限並擋掉 "." ".." 和含 '/' 的名字
+    dentry = lookup_one(file_mnt_idmap(filp), name, filp->f_path.dentry, item->name_len);
+    if (IS_ERR(dentry))
+        return PTR_ERR(dentry);
+
+    switch (item->op) {
+    case OSFS_BATCH_CREATE:
+        ret = osfs_batch_create(filp, dentry, item);
+        if (!ret && item->data_len) {
+            *created = dentry;
+            return 0;
+        }
+        break;
+    case OSFS_BATCH_UNLINK:
+        if (d_really_is_negative(dentry)) {
+            ret = -ENOENT;
+            break;
+        }
+        ret = security_path_unlink(&filp->f_path, dentry);
+        if (!ret)
+            ret = vfs_unlink(file_mnt_idmap(filp), dir, dentry, NULL);
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+
+    dput(dentry);
+    return ret;
+}
+
+/*
+ * A file created in the current run of OSFS_IOC_BATCH items, waiting for its
+ * data to be written once the run's directory lock is dropped.
+ */
+struct osfs_batch_pending {
+    struct dentry *dentry;
+    struct osfs_batch_item item;
+    u32 index;
+};
+
+/**
+ * Function: osfs_ioc_batch
+ * Description: OSFS_IOC_BATCH: runs a batch of create+write / unlink operations
+ *   in the directory, instead of one open/write/close (or unlink) syscall round
+ *   trip per file. Items are processed in runs of OSFS_BATCH_LOCK_ITEMS: each
+ *   run takes the directory lock once for its creates and unlinks, and the
+ *   files it created get their data written after that lock is dropped, so a
+ *   large batch does not lock out other users of the directory.
+ * Returns:
+ *   - The number of items processed; each has its result set. Processing stops
+ *     early only if the item array cannot be accessed, the mount becomes
+ *     read-only, or a fatal signal arrives.
+ *   - A negative errno if nothing was processed.
+ */
+static long osfs_ioc_batch(struct file *filp, struct osfs_batch __user *argp)
+{
+    struct osfs_batch_item __user *items;
+    struct osfs_batch_pending *pending;
+    struct osfs_batch_item item;
+    struct osfs_batch batch;
+    struct dentry *created;
+    unsigned int nr_pending, j;
+    char *name;
+    long ret = 0;
+    u32 i = 0, end;
+
+    if (copy_from_user(&batch, argp, sizeof(batch)))
+        return -EFAULT;
+    if (batch.flags)
+        return -EINVAL;
+    if (batch.count > OSFS_BATCH_MAX)
+        return -E2BIG;
+    items = u64_to_user_ptr(batch.items);
+
+    pending = kmalloc_array(OSFS_BATCH_LOCK_ITEMS, sizeof(*pending), GFP_KERNEL);
+    if (!pending)
+        return -ENOMEM;
+    name = kmalloc(MAX_FILENAME_LEN + 1, GFP_KERNEL);
+    if (!name) {
+        kfree(pending);
+        return -ENOMEM;
+    }
+
+    // 每 OSFS_BATCH_LOCK_ITEMS 個項目為一輪，一輪只拿一次目錄鎖；
+    // 這輪建立的檔案先記下來，放掉鎖之後再一起寫入資料
+    while (!ret && i < batch.count) {
+        ret = osfs_batch_lock(filp);
+        if (ret)
+            break;
+
+        nr_pending = 0;
+        end = min_t(u32, batch.count, i + OSFS_BATCH_LOCK_ITEMS);
+        for (; i < end; i++) {
+            if (fatal_signal_pending(current)) {
+                ret = -EINTR;
+                break;
+            }
+            if (copy_from_user(&item, &items[i], sizeof(item))) {
+                ret = -EFAULT;
+                break;
+            }
+
+            created = NULL;
+            item.result = osfs_batch_one(filp, &item, name, &created);
+            if (created) {
+                pending[nr_pending].dentry = created;
+                pending[nr_pending].item = item;
+                pending[nr_pending].index = i;
+                nr_pending++;
+                continue;
+            }
+
+            if (put_user(item.result, &items[i].result)) {
+                ret = -EFAULT;
+                break;
+            }
+        }
+
+        // 寫資料前先放掉目錄鎖與 mnt write：vfs_iter_write 會自己拿 freeze protection
+        osfs_batch_unlock(filp);
+
+        for (j = 0; j < nr_pending; j++) {
+            pending[j].item.result = osfs_batch_write(filp, pending[j].dentry,
+                                                      &pending[j].item);
+            dput(pending[j].dentry);
+            // 結果存不回去：只回報到這個項目之前
+            if (put_user(pending[j].item.result, &items[pending[j].index].result)) {
+                ret = -EFAULT;
+                i = min(i, pending[j].index);
+            }
+        }
+        cond_resched();
+    }
+
+    kfree(name);
+    kfree(pending);
+    if (i || !batch.count)
+        return i;
+    return ret;
+}
+
+/**
+ * Function: osfs_multi_read_one
+ * Description: Reads one OSFS_IOC_MULTI_READ file into buf. The name goes
+ *   through the dcache and osfs_lookup without the directory lock. The file is
+ *   then opened and read in the kernel like open/read/close would, so the LSM
+ *   open and file-permission hooks, fsnotify and atime all see the access.
+ * Returns:
+ *   - The number of bytes stored.
+ *   - A negative errno.
+ */
+static ssize_t osfs_multi_read_one(struct file *filp, struct osfs_read_item *item,
+                                   char *name, char __user *buf, size_t space)
+{
+    struct dentry *dentry;
+    struct inode *inode;
+    struct iov_iter iter;
+    struct file *file;
+    struct path path;
+    loff_t size;
+    loff_t pos = 0;
+    ssize_t ret;
+
+    if (item->reserved)
+        return -EINVAL;
+    if (!item->name_len || item->name_len > MAX_FILENAME_LEN)
+        return -ENAMETOOLONG;
+    if (copy_from_user(name, u64_to_user_ptr(item->name), item->name_len))
+        return -EFAULT;
+
+    // lookup_one_unlocked: 不需要拿目錄鎖，dcache 沒有時才會呼叫 osfs_lookup
+    dentry = lookup_one_unlocked(file_mnt_idmap(filp), name, filp->f_path.dentry,
+                                 item->name_len);
+    if (IS_ERR(dentry))
+        return PTR_ERR(dentry);
+
+    inode = d_inode(dentry);
+    if (!inode) {
+        ret = -ENOENT;
+        goto out_dput;
+    }
+    if (!S_ISREG(inode->i_mode)) {
+        ret = S_ISDIR(inode->i_mode) ? -EISDIR : -EINVAL;
+        goto out_dput;
+    }
+    // dentry_open 不做 open(2) 的 may_open 權限檢查，自己檢查讀取權限
+    ret = inode_permission(file_mnt_idmap(filp), inode, MAY_READ);
+    if (ret)
+        goto out_dput;
+
+    size = i_size_read(inode);
+    // length 欄位是 32 位元
+    if (size > U32_MAX) {
+        ret = -EFBIG;
+        goto out_dput;
+    }
+    if (size > space) {
+        ret = -EOVERFLOW;
+        goto out_dput;
+    }
+    ret = import_ubuf(ITER_DEST, buf, size, &iter);
+    if (ret)
+        goto out_dput;
+
+    path.mnt = filp->f_path.mnt;
+    path.dentry = dentry;
+    file = dentry_open(&path, O_RDONLY, current_cred());
+    if (IS_ERR(file)) {
+        ret = PTR_ERR(file);
+        goto out_dput;
+    }
+    // vfs_iter_read 會做 rw_verify_area (LSM file hook) 與 fsnotify_access
+    ret = vfs_iter_read(file, &iter, &pos, 0);
+    // bitmap engine 的 read_iter 不更新 atime，這裡補上
+    if (ret >= 0)
+        file_accessed(file);
+    fput(file);
+
+out_dput:
+    dput(dentry);
+    return ret;
+}
+
+/**
+ * Function: osfs_ioc_multi_read
+ * Description: OSFS_IOC_MULTI_READ: reads many small files of the directory
+ *   into one buffer in a single syscall, instead of an open/read/close round
+ *   trip per file. The directory is not locked; each file is read like a plain
+ *   read(2) racing with writers would be.
+ * Returns:
+ *   - The number of items processed; each has offset, length and result set.
+ *   - A negative errno if nothing was processed.
+ */
+static long osfs_ioc_multi_read(struct file *filp, struct osfs_multi_read __user *argp)
+{
+    struct osfs_read_item __user *items;
+    struct osfs_read_item item;
+    struct osfs_multi_read req;
+    char __user *buf;
+    u64 used = 0;
+    ssize_t len;
+    char *name;
+    u32 i;
+
+    if (copy_from_user(&req, argp, sizeof(req)))
+        return -EFAULT;
+    if (req.flags)
+        return -EINVAL;
+    if (req.count > OSFS_BATCH_MAX)
+        return -E2BIG;
+    items = u64_to_user_ptr(req.items);
+    buf = u64_to_user_ptr(req.buf);
+
+    name = kmalloc(MAX_FILENAME_LEN + 1, GFP_KERNEL);
+    if (!name)
+        return -ENOMEM;
+
+    for (i = 0; i < req.count; i++) {
+        if (fatal_signal_pending(current))
+            break;
+        if (copy_from_user(&item, &items[i], sizeof(item)))
+            break;
+
+        len = osfs_multi_read_one(filp, &item, name, buf + used, req.buf_len - used);
+        item.offset = used;
+        item.length = len > 0 ? len : 0;
+        item.result = len < 0 ? len : 0;
+        used += item.length;
+
+        if (copy_to_user(&items[i], &item, sizeof(item)))
+            break;
+        cond_resched();
+    }
+    kfree(name);
+
+    if (!i && req.count)
+        return fatal_signal_pending(current) ? -EINTR : -EFAULT;
+    return i;
+}
+
+/**
+ * Function: osfs_fill_stat
+ * Description: Fills an osfs_stat straight from an inode-table entry, without
+ *   instantiating a VFS inode. Size, block count and mtime/ctime come from one
+ *   consistent snapshot under the inode's metadata seqlock.
+ */
+static void osfs_fill_stat(struct super_block *sb, struct osfs_inode *osfs_inode,
+                           struct osfs_stat *st)
+{
+    unsigned int seq;
+
+    memset(st, 0, sizeof(*st));
+    st->ino = osfs_inode->i_ino;
+    st->mode = READ_ONCE(osfs_inode->i_mode);
+    st->nlink = READ_ONCE(osfs_inode->i_links_count);
+    st->uid = from_kuid_munged(current_user_ns(), make_kuid(sb->s_user_ns, osfs_inode->i_uid));
+    st->gid = from_kgid_munged(current_user_ns(), make_kgid(sb->s_user_ns, osfs_inode->i_gid));
+    st->atime_sec = osfs_inode->__i_atime.tv_sec;
+    st->atime_nsec = osfs_inode->__i_atime.tv_nsec;
+
+    do {
+        seq = read_seqbegin(&osfs_inode->i_meta_lock);
+        st->size = osfs_inode->i_size;
+        st->blocks = osfs_inode->i_blocks;
+        st->mtime_sec = osfs_inode->__i_mtime.tv_sec;
+        st->mtime_nsec = osfs_inode->__i_mtime.tv_nsec;
+        st->ctime_sec = osfs_inode->__i_ctime.tv_sec;
+        st->ctime_nsec = osfs_inode->__i_ctime.tv_nsec;
+    } while (read_seqretry(&osfs_inode->i_meta_lock, seq));
+}
+
+/**
+ * Function: osfs_ioc_readdirplus
+ * Description: OSFS_IOC_READDIRPLUS: lists a directory together with each
+ *   entry's attributes, read from the inode table. Replaces a readdir plus one
+ *   lookup + iget + stat per name with one syscall per buffer, so it needs
+ *   search (exec) permission on the directory just like those lookups would.
+ */
+static long osfs_ioc_readdirplus(struct file *filp, struct osfs_readdirplus __user *argp)
+{
+    struct inode *dir = file_inode(filp);
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
+    struct osfs_inode *parent_inode = dir->i_private;
+    struct osfs_dirent_plus __user *out;
+    struct osfs_dir_entry *dir_entries;
+    struct osfs_inode *osfs_inode;
+    struct osfs_dirent_plus *ent;
+    struct osfs_readdirplus req;
+    u64 dir_entry_count;
+    u32 filled = 0;
+    long ret = 0;
+    u64 i;
+
+    if (copy_from_user(&req, argp, sizeof(req)))
+        return -EFAULT;
+    if (req.flags)
+        return -EINVAL;
+    out = u64_to_user_ptr(req.buf);
+
+    // 讀目錄只需要讀取權限，但屬性等同逐一 lookup + stat，要和 stat(2) 一樣有搜尋 (執行) 權限
+    ret = inode_permission(file_mnt_idmap(filp), dir, MAY_EXEC);
+    if (ret)
+        return ret;
+
+    // kzalloc: pad 永遠不會被寫到，不能把 kernel heap 的殘值複製給 user space
+    ent = kzalloc(sizeof(*ent), GFP_KERNEL);
+    if (!ent)
+        return -ENOMEM;
+
+    inode_lock_shared(dir);
+    dir_entry_count = parent_inode->i_blocks ? parent_inode->i_size / sizeof(struct osfs_dir_entry) : 0;
+    dir_entries = (struct osfs_dir_entry *)(sb_info->data_blocks +
+                                            parent_inode->i_blocks_array[0] * BLOCK_SIZE);
+
+    for (i = req.cursor; i < dir_entry_count && filled < req.count; i++) {
+        if (!dir_entries[i].inode_no)
+            continue; // 已刪除的空位
+        osfs_inode = osfs_get_osfs_inode(dir->i_sb, dir_entries[i].inode_no);
+        if (!osfs_inode)
+            continue;
+
+        osfs_fill_stat(dir->i_sb, osfs_inode, &ent->stat);
+        // 檔名剛好 255 字元時陣列裡沒有 '\0'
+        ent->name_len = strnlen(dir_entries[i].filename, MAX_FILENAME_LEN);
+        memcpy(ent->name, dir_entries[i].filename, ent->name_len);
+        memset(ent->name + ent->name_len, 0, sizeof(ent->name) - ent->name_len);
+
+        if (copy_to_user(&out[filled], ent, sizeof(*ent))) {
+            ret = -EFAULT;
+            break;
+        }
+        filled++;
+    }
+    inode_unlock_shared(dir);
+    kfree(ent);
+
+    // 已經存了幾筆就回報那幾筆，游標停在沒存進去的那一項，下次從那裡繼續
+    if (ret && !filled)
+        return ret;
+    req.cursor = i;
+    if (put_user(req.cursor, &argp->cursor))
+        return -EFAULT;
+    return filled;
+}
+
+/**
+ * Function: osfs_ioc_bulkstat
+ * Description: OSFS_IOC_BULKSTAT: returns the attributes of every allocated
+ *   inode by scanning inode_bitmap, so a backup indexer needs no path walk and
+ *   no per-file stat. No lock is held across the scan: an inode created or
+ *   deleted meanwhile may or may not be reported.
+ */
+static long osfs_ioc_bulkstat(struct file *filp, struct osfs_bulkstat __user *argp)
+{
+    struct super_block *sb = file_inode(filp)->i_sb;
+    struct osfs_sb_info *sb_info = sb->s_fs_info;
+    struct osfs_inode *osfs_inode;
+    struct osfs_stat __user *out;
+    struct osfs_bulkstat req;
+    struct osfs_stat st;
+    u32 filled = 0;
+    unsigned long ino;
+
+    if (!capable(CAP_SYS_ADMIN))
+        return -EPERM;
+    if (copy_from_user(&req, argp, sizeof(req)))
+        return -EFAULT;
+    if (req.flags)
+        return -EINVAL;
+    out = u64_to_user_ptr(req.buf);
+
+    // inode 0 不使用，從 1 (根目錄) 開始
+    ino = clamp_t(u64, req.cursor, ROOT_INODE, sb_info->inode_count);
+    for (ino = find_next_bit(sb_info->inode_bitmap, sb_info->inode_count, ino);
+         ino < sb_info->inode_count && filled < req.count;
+         ino = find_next_bit(sb_info->inode_bitmap, sb_info->inode_count, ino + 1)) {
+        osfs_inode = osfs_get_osfs_inode(sb, ino);
+        if (!osfs_inode)
+            continue;
+
+        osfs_fill_stat(sb, osfs_inode, &st);
+        if (copy_to_user(&out[filled], &st, sizeof(st))) {
+            // 已經存了幾筆就回報那幾筆，游標停在這個 inode，下次從它繼續
+            if (!filled)
+                return -EFAULT;
+            break;
+        }
+        filled++;
+        cond_resched();
+    }
+
+    // 游標停在下一個還沒回報的 inode 編號
+    req.cursor = min_t(u64, ino, sb_info->inode_count);
+    if (put_user(req.cursor, &argp->cursor))
+        return -EFAULT;
+    return filled;
+}
+
+/**
+ * Function: osfs_dir_ioctl
+ * Description: ioctl entry point for osfs directories (see osfs_ioctl.h).
+ */
+long osfs_dir_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    switch (cmd) {
+    case OSFS_IOC_BATCH:
+        return osfs_ioc_batch(filp, (struct osfs_batch __user *)arg);
+    case OSFS_IOC_MULTI_READ:
+        return osfs_ioc_multi_read(filp, (struct osfs_multi_read __user *)arg);
+    case OSFS_IOC_READDIRPLUS:
+        return osfs_ioc_readdirplus(filp, (struct osfs_readdirplus __user *)arg);
+    case OSFS_IOC_BULKSTAT:
+        return osfs_ioc_bulkstat(filp, (struct osfs_bulkstat __user *)arg);
+    default:
+        return -ENOTTY;
+    }
+}
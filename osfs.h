@@ -9,25 +9,75 @@
 #include <linux/vmalloc.h>
 #include <linux/string.h>
 #include <linux/module.h>
+#include <linux/hashtable.h>
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
+#include "osfs_ioctl.h"
 
 #define OSFS_MAGIC 0x051AB520
 #define BLOCK_SIZE 4096       // Ensure BLOCK_SIZE is defined
 #define INODE_COUNT 20         // Maximum of 20 inodes in the filesystem
 #define DATA_BLOCK_COUNT 20    // Assume there are 20 data blocks
+// The data blocks live in one vmalloc region sized at mount time, and mmap and
+// splice hand out their pages directly, so a block cannot be compressed or moved
+// behind a user's back. Memory is saved by not holding blocks at all: holes,
+// all-zero writes, truncate and hole punching return them to the bitmap.
 #define MAX_FILENAME_LEN 255
 #define MAX_DIR_ENTRIES (BLOCK_SIZE / sizeof(struct osfs_dir_entry))
 
 // BONUS: Support multiple blocks per file (e.g., 5 blocks = 20KB max file size)
 #define MAX_EXTENTS 5 
 
+// Symlink targets shorter than this are stored in the inode itself (fast symlink)
+#define OSFS_INLINE_LINK_LEN 64
+
+// Number of pages osfs_mmap_fault maps per fault, starting at the faulting page
+#define OSFS_FAULT_AROUND_PAGES 16
+
+// OSFS_IOC_BATCH takes the directory lock once per run of this many items and
+// writes the files created in a run after dropping it
+#define OSFS_BATCH_LOCK_ITEMS 32
+
 #define BITMAP_SIZE(bits) (((bits) + BITS_PER_LONG - 1) / BITS_PER_LONG)
 
 // Calculate the size of the bitmap (in units of unsigned long)
 #define INODE_BITMAP_SIZE BITMAP_SIZE(INODE_COUNT)
 #define BLOCK_BITMAP_SIZE BITMAP_SIZE(DATA_BLOCK_COUNT)
+// Per-block reference counts (uint16_t each), also sized in unsigned longs
+#define BLOCK_REFS_SIZE \
+    ((DATA_BLOCK_COUNT * sizeof(uint16_t) + sizeof(unsigned long) - 1) / sizeof(unsigned long))
+
+// Buckets of the per-mount dedup hash table (2^bits)
+#define OSFS_DEDUP_HASH_BITS 5
 
 #define ROOT_INODE 1            // Define the root inode as 1
 
+// i_blocks_array value of a hole (unmapped logical block, reads as zeros).
+// Block 0 is the root directory's first block, allocated at mount and never
+// freed, so no file can ever map it.
+#define OSFS_HOLE 0
+
+/**
+ * Enum: osfs_engine
+ * Description: Storage engine for regular file data, selected with the
+ *              "engine=" mount option.
+ */
+enum osfs_engine {
+    OSFS_ENGINE_BITMAP = 0,     // Fixed data_blocks region + block_bitmap (default, deterministic footprint)
+    OSFS_ENGINE_PAGECACHE,      // Data lives in the inode's page cache (ramfs-style)
+};
+
+/**
+ * Struct: osfs_dedup_entry
+ * Description: Dedup hash-table entry of one data block (mount option "dedup").
+ *              A block is in the table only while its contents cannot change:
+ *              it is taken out before anything writes to it again.
+ */
+struct osfs_dedup_entry {
+    struct hlist_node node;      // Link in osfs_sb_info.dedup_table
+    u64 hash;                    // xxh64 of the block contents
+};
+
 /**
  * Struct: osfs_sb_info
  * Description: Superblock information for the osfs filesystem.
@@ -39,15 +89,23 @@ struct osfs_sb_info {
     uint32_t block_count;        // Total number of data blocks
     uint32_t nr_free_inodes;     // Number of free inodes
     uint32_t nr_free_blocks;     // Number of free data blocks
+    uint32_t engine;             // Storage engine for regular files (enum osfs_engine)
+    uint32_t dedup;              // Share identical full blocks between files ("dedup" option)
     unsigned long *inode_bitmap; // Pointer to the inode bitmap
+    spinlock_t inode_bitmap_lock; // Guards inode_bitmap and nr_free_inodes
     unsigned long *block_bitmap; // Pointer to the data block bitmap
+    uint16_t *block_refs;        // Files sharing each data block (reflink); 0 when free
+    struct osfs_dedup_entry *dedup_entries;  // One entry per data block
+    DECLARE_HASHTABLE(dedup_table, OSFS_DEDUP_HASH_BITS); // Hashed blocks, by contents
+    spinlock_t block_lock;       // Guards block_bitmap, block_refs, nr_free_blocks and dedup_table
     void *inode_table;           // Pointer to the inode table
     void *data_blocks;           // Pointer to the data blocks area
 };
 
 /**
  * Struct: osfs_dir_entry
- * Description: Directory entry structure.
+ * Description: Directory entry structure. A slot with inode_no 0 (inode 0 is
+ *   never used) is a free slot left behind by a removed entry.
  */
 struct osfs_dir_entry {
     char filename[MAX_FILENAME_LEN]; // File name
@@ -69,26 +127,48 @@ struct osfs_inode {
     struct timespec64 __i_atime;        // Last access time
     struct timespec64 __i_mtime;        // Last modification time
     struct timespec64 __i_ctime;        // Creation time
-    
+    seqlock_t i_meta_lock;              // Guards i_size/i_blocks/mtime/ctime for lockless getattr
+
     // 原版: uint32_t i_block;  <-- 只存一個整數，指向唯一的資料區塊
     // Bonus: uint32_t i_blocks_array[MAX_EXTENTS]; <-- 改成陣列，存多個區塊編號
-    uint32_t i_blocks_array[MAX_EXTENTS]; 
+    // 短的 symlink (fast symlink) 直接把目標路徑存在這裡，不佔資料區塊
+    union {
+        uint32_t i_blocks_array[MAX_EXTENTS];
+        char i_link[OSFS_INLINE_LINK_LEN];   // NUL-terminated target if i_size < OSFS_INLINE_LINK_LEN
+    };
 };
 
 struct inode *osfs_iget(struct super_block *sb, unsigned long ino);
 struct osfs_inode *osfs_get_osfs_inode(struct super_block *sb, uint32_t ino);
 int osfs_get_free_inode(struct osfs_sb_info *sb_info);
+void osfs_release_inode(struct osfs_sb_info *sb_info, uint32_t ino);
 int osfs_alloc_data_block(struct osfs_sb_info *sb_info, uint32_t *block_no);
+int osfs_alloc_data_block_goal(struct osfs_sb_info *sb_info, uint32_t goal, uint32_t *block_no);
 int osfs_fill_super(struct super_block *sb, void *data, int silent);
 struct inode *osfs_new_inode(const struct inode *dir, umode_t mode);
 void osfs_free_data_block(struct osfs_sb_info *sb_info, uint32_t block_no);
-void osfs_destroy_inode(struct inode *inode);
+uint32_t osfs_free_data_blocks(struct osfs_sb_info *sb_info, uint32_t *block_slots,
+                               uint32_t count);
+void osfs_get_data_block(struct osfs_sb_info *sb_info, uint32_t block_no);
+int osfs_prepare_data_block(struct osfs_sb_info *sb_info, uint32_t *block_slot,
+                            uint32_t goal, bool nowait, bool *new_block);
+void osfs_dedup_data_block(struct osfs_sb_info *sb_info, uint32_t *block_slot);
+void osfs_evict_inode(struct inode *inode);
+void osfs_init_file_inode(struct inode *inode);
+void osfs_init_symlink_inode(struct inode *inode);
+bool osfs_inode_is_inline(struct inode *inode);
+void osfs_sync_inode_meta(struct inode *inode);
+int osfs_setattr(struct mnt_idmap *idmap, struct dentry *dentry, struct iattr *attr);
+uint32_t osfs_count_idle_blocks(struct osfs_sb_info *sb_info);
+long osfs_dir_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
 
 // External Operations Structures
 extern const struct inode_operations osfs_file_inode_operations;
 extern const struct file_operations osfs_file_operations;
+extern const struct file_operations osfs_pagecache_file_operations;
 extern const struct inode_operations osfs_dir_inode_operations;
 extern const struct file_operations osfs_dir_operations;
+extern const struct inode_operations osfs_symlink_inode_operations;
 extern const struct super_operations osfs_super_ops;
 
 #endif /* _OSFS_H */
\ No newline at end of file
@@ -115,6 +115,13 @@ static void osfs_kill_superblock(struct super_block *sb)
 
     pr_info("osfs_kill_superblock: Unmounting file system\n");
 
+    // engine=pagecache pins every dentry (ramfs-style), so they have to be
+    // dropped with kill_litter_super before the inodes can go away.
+    if (sb_info && sb_info->engine == OSFS_ENGINE_PAGECACHE)
+        kill_litter_super(sb);
+    else
+        kill_anon_super(sb);
+
     if (sb_info) {
         pr_info("osfs_kill_superblock: free blcok \n");
 
@@ -0,0 +1,154 @@
+#ifndef _OSFS_IOCTL_H
+#define _OSFS_IOCTL_H
+
+/*
+ * osfs ioctl interface, shared by the kernel module and user-space tools.
+ * Pointers are passed as __u64 so the layout is the same for 32-bit and
+ * 64-bit callers.
+ */
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define OSFS_IOC_MAGIC 0xB5
+
+// Maximum number of items in one OSFS_IOC_BATCH call
+#define OSFS_BATCH_MAX 4096
+
+/**
+ * Enum: osfs_batch_op
+ * Description: Operation of one osfs_batch_item.
+ */
+enum osfs_batch_op {
+    OSFS_BATCH_CREATE = 1,      // Create a regular file and write data_len bytes to it
+    OSFS_BATCH_UNLINK = 2,      // Remove a name
+};
+
+/**
+ * Struct: osfs_batch_item
+ * Description: One operation of OSFS_IOC_BATCH, relative to the directory
+ *              the ioctl is issued on.
+ */
+struct osfs_batch_item {
+    __u32 op;                   // enum osfs_batch_op
+    __u32 mode;                 // CREATE: permission bits of the new file
+    __u64 name;                 // Pointer to the name (not NUL-terminated)
+    __u32 name_len;             // Length of the name
+    __u32 data_len;             // CREATE: number of bytes at data
+    __u64 data;                 // CREATE: pointer to the initial contents
+    __s32 result;               // Out: 0 or a negative errno
+    __u32 reserved;             // Must be 0
+};
+
+/**
+ * Struct: osfs_batch
+ * Description: Argument of OSFS_IOC_BATCH. The ioctl returns the number of
+ *              items processed; each processed item has its result filled in.
+ */
+struct osfs_batch {
+    __u64 items;                // Pointer to an array of struct osfs_batch_item
+    __u32 count;                // Number of items (at most OSFS_BATCH_MAX)
+    __u32 flags;                // Must be 0
+};
+
+/**
+ * Struct: osfs_read_item
+ * Description: One file of OSFS_IOC_MULTI_READ, named relative to the
+ *              directory the ioctl is issued on.
+ */
+struct osfs_read_item {
+    __u64 name;                 // Pointer to the name (not NUL-terminated)
+    __u32 name_len;             // Length of the name
+    __u32 reserved;             // Must be 0
+    __u64 offset;               // Out: where the contents start in the buffer
+    __u32 length;               // Out: number of bytes stored (the file size)
+    __s32 result;               // Out: 0, -EOVERFLOW if the rest of the buffer
+                                //      is too small for the file, -EFBIG if the
+                                //      file is 4 GiB or larger, or a negative errno
+};
+
+/**
+ * Struct: osfs_multi_read
+ * Description: Argument of OSFS_IOC_MULTI_READ. The files' contents are packed
+ *              back to back into buf; the ioctl returns the number of items
+ *              processed.
+ */
+struct osfs_multi_read {
+    __u64 items;                // Pointer to an array of struct osfs_read_item
+    __u32 count;                // Number of items (at most OSFS_BATCH_MAX)
+    __u32 flags;                // Must be 0
+    __u64 buf;                  // Pointer to the output buffer
+    __u64 buf_len;              // Size of the output buffer
+};
+
+/**
+ * Struct: osfs_stat
+ * Description: Attributes of one inode, as returned by OSFS_IOC_READDIRPLUS
+ *              and OSFS_IOC_BULKSTAT.
+ *              Owner ids are in the caller's user namespace.
+ */
+struct osfs_stat {
+    __u32 ino;                  // Inode number
+    __u32 mode;                 // File type and permission bits
+    __u32 nlink;                // Number of hard links
+    __u32 uid;                  // Owner
+    __u32 gid;                  // Group
+    __u32 reserved;
+    __u64 size;                 // Size in bytes
+    __u64 blocks;               // Number of data blocks
+    __s64 atime_sec;
+    __s64 mtime_sec;
+    __s64 ctime_sec;
+    __u32 atime_nsec;
+    __u32 mtime_nsec;
+    __u32 ctime_nsec;
+    __u32 pad;
+};
+
+/**
+ * Struct: osfs_dirent_plus
+ * Description: One directory entry with the attributes of its inode.
+ */
+struct osfs_dirent_plus {
+    struct osfs_stat stat;
+    __u32 name_len;             // Length of name, without the NUL
+    __u32 pad;                  // Always 0 (no implicit padding in the record)
+    char name[256];             // NUL-terminated name
+};
+
+/**
+ * Struct: osfs_readdirplus
+ * Description: Argument of OSFS_IOC_READDIRPLUS. Entries are read starting at
+ *              the entry index in cursor, which is advanced past the returned
+ *              entries. The ioctl returns the number of entries stored in buf;
+ *              0 means the end of the directory. As with readdir, entries
+ *              added or removed between calls may be missed or seen twice.
+ */
+struct osfs_readdirplus {
+    __u64 buf;                  // Pointer to an array of struct osfs_dirent_plus
+    __u32 count;                // Capacity of buf, in entries
+    __u32 flags;                // Must be 0
+    __u64 cursor;               // In/out: index of the next entry (0 to start)
+};
+
+/**
+ * Struct: osfs_bulkstat
+ * Description: Argument of OSFS_IOC_BULKSTAT (requires CAP_SYS_ADMIN). Every
+ *              allocated inode of the filesystem is returned in inode-number
+ *              order, starting at cursor, which is advanced past the returned
+ *              inodes. The ioctl returns the number of records stored in buf;
+ *              0 means the scan is complete.
+ */
+struct osfs_bulkstat {
+    __u64 buf;                  // Pointer to an array of struct osfs_stat
+    __u32 count;                // Capacity of buf, in records
+    __u32 flags;                // Must be 0
+    __u64 cursor;               // In/out: next inode number to scan (0 to start)
+};
+
+#define OSFS_IOC_BATCH _IOW(OSFS_IOC_MAGIC, 1, struct osfs_batch)
+#define OSFS_IOC_MULTI_READ _IOW(OSFS_IOC_MAGIC, 2, struct osfs_multi_read)
+#define OSFS_IOC_READDIRPLUS _IOWR(OSFS_IOC_MAGIC, 3, struct osfs_readdirplus)
+#define OSFS_IOC_BULKSTAT _IOWR(OSFS_IOC_MAGIC, 4, struct osfs_bulkstat)
+
+#endif /* _OSFS_IOCTL_H */
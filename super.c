@@ -1,27 +1,173 @@
 #include <linux/fs.h>
 #include <linux/pagemap.h>
+#include <linux/parser.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/statfs.h>
 #include "osfs.h"
 
+/**
+ * Function: osfs_show_options
+ * Description: Shows the non-default mount options in /proc/mounts.
+ */
+static int osfs_show_options(struct seq_file *m, struct dentry *root)
+{
+    struct osfs_sb_info *sb_info = root->d_sb->s_fs_info;
+
+    if (sb_info->engine == OSFS_ENGINE_PAGECACHE)
+        seq_puts(m, ",engine=pagecache");
+    if (sb_info->dedup)
+        seq_puts(m, ",dedup");
+    return 0;
+}
+
+/**
+ * Function: osfs_statfs
+ * Description: Reports the real block and inode usage from the bitmaps, so
+ *   space freed by unlink/truncate shows up immediately. Freed blocks whose
+ *   page is still pinned are not counted as free until they can be allocated.
+ *   With engine=pagecache file data is not in the block area and is not
+ *   counted (see README.md).
+ */
+static int osfs_statfs(struct dentry *dentry, struct kstatfs *buf)
+{
+    struct osfs_sb_info *sb_info = dentry->d_sb->s_fs_info;
+
+    buf->f_type = OSFS_MAGIC;
+    buf->f_bsize = BLOCK_SIZE;
+    buf->f_namelen = MAX_FILENAME_LEN;
+    buf->f_blocks = sb_info->block_count;
+    buf->f_bfree = buf->f_bavail = osfs_count_idle_blocks(sb_info);
+    buf->f_files = sb_info->inode_count - 1; // Inode 0 is never used
+    buf->f_ffree = READ_ONCE(sb_info->nr_free_inodes);
+    return 0;
+}
+
+/**
+ * Function: osfs_dirty_inode
+ * Description: Called from mark_inode_dirty. Mirrors the link count and the
+ *   timestamps into the osfs_inode, so every operation that changes them on the
+ *   VFS inode and marks it dirty (link/unlink/rename setting ctime,
+ *   file_update_time from a page-cache mmap store, ...) is seen by osfs_iget,
+ *   osfs_getattr, READDIRPLUS and BULKSTAT.
+ */
+static void osfs_dirty_inode(struct inode *inode, int flags)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+
+    if (!osfs_inode)
+        return;
+
+    osfs_inode->i_links_count = inode->i_nlink;
+    write_seqlock(&osfs_inode->i_meta_lock);
+    osfs_inode->__i_atime = inode_get_atime(inode);
+    osfs_inode->__i_mtime = inode_get_mtime(inode);
+    osfs_inode->__i_ctime = inode_get_ctime(inode);
+    write_sequnlock(&osfs_inode->i_meta_lock);
+}
+
 /**
  * Struct: osfs_super_ops
  * Description: Defines the superblock operations for the osfs filesystem.
  */
 const struct super_operations osfs_super_ops = {
-    .statfs = simple_statfs,            // Provides filesystem statistics
+    .statfs = osfs_statfs,              // Provides filesystem statistics
     .drop_inode = generic_delete_inode, // Generic inode deletion
-    .destroy_inode = osfs_destroy_inode,
-
+    .dirty_inode = osfs_dirty_inode,
+    .evict_inode = osfs_evict_inode,
+    .show_options = osfs_show_options,
 };
 
-void osfs_destroy_inode(struct inode *inode)
+/**
+ * Function: osfs_evict_inode
+ * Description: Called when the last reference to a VFS inode goes away. If the
+ *   file was also unlinked (nlink == 0), its data blocks and its inode number go
+ *   back to the bitmaps right away, so create/delete churn does not leak space.
+ */
+void osfs_evict_inode(struct inode *inode)
 {
-    if (inode->i_private) {
-        inode->i_private = NULL;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct osfs_inode *osfs_inode = inode->i_private;
+
+    // engine=pagecache 的資料在 page cache 裡，這裡一起丟掉
+    truncate_inode_pages_final(&inode->i_data);
+    clear_inode(inode);
+
+    if (inode->i_nlink)
+        return;
+
+    // 最後一個 link 已刪除、也沒人開著：把區塊和 inode 編號還回 bitmap
+    // (inline symlink 的 union 裡放的是路徑字串，不是區塊編號)
+    if (osfs_inode && !osfs_inode_is_inline(inode)) {
+        osfs_free_data_blocks(sb_info, osfs_inode->i_blocks_array, MAX_EXTENTS);
+        osfs_inode->i_blocks = 0;
     }
+    osfs_release_inode(sb_info, inode->i_ino);
 }
 
 
+enum {
+    Opt_engine_bitmap,
+    Opt_engine_pagecache,
+    Opt_dedup,
+    Opt_err,
+};
+
+static const match_table_t osfs_tokens = {
+    {Opt_engine_bitmap, "engine=bitmap"},
+    {Opt_engine_pagecache, "engine=pagecache"},
+    {Opt_dedup, "dedup"},
+    {Opt_err, NULL},
+};
+
+/**
+ * Function: osfs_parse_options
+ * Description: Parses the comma-separated mount options into sb_info.
+ * Inputs:
+ * - data: The option string passed to mount (may be NULL).
+ * - sb_info: The superblock information to fill.
+ * Returns:
+ * - 0 on success.
+ * - -EINVAL on an unknown option, or dedup with engine=pagecache (that engine
+ *   keeps file data in the page cache, which dedup never sees).
+ */
+static int osfs_parse_options(char *data, struct osfs_sb_info *sb_info)
+{
+    substring_t args[MAX_OPT_ARGS];
+    char *p;
+
+    sb_info->engine = OSFS_ENGINE_BITMAP;
+    sb_info->dedup = 0;
+    if (!data)
+        return 0;
+
+    while ((p = strsep(&data, ",")) != NULL) {
+        if (!*p)
+            continue;
+
+        switch (match_token(p, osfs_tokens, args)) {
+        case Opt_engine_bitmap:
+            sb_info->engine = OSFS_ENGINE_BITMAP;
+            break;
+        case Opt_engine_pagecache:
+            sb_info->engine = OSFS_ENGINE_PAGECACHE;
+            break;
+        case Opt_dedup:
+            sb_info->dedup = 1;
+            break;
+        default:
+            pr_err("osfs: Unrecognized mount option '%s'\n", p);
+            return -EINVAL;
+        }
+    }
+
+    if (sb_info->dedup && sb_info->engine == OSFS_ENGINE_PAGECACHE) {
+        pr_err("osfs: 'dedup' is only supported with engine=bitmap\n");
+        return -EINVAL;
+    }
+    return 0;
+}
+
 /**
  * Function: osfs_fill_super
  * Description: Initializes the superblock with filesystem-specific information during mount.
@@ -50,7 +196,10 @@ int osfs_fill_super(struct super_block *sb, void *data, int silent)
     total_memory_size = sizeof(struct osfs_sb_info) +
                         INODE_BITMAP_SIZE * sizeof(unsigned long) +
                         BLOCK_BITMAP_SIZE * sizeof(unsigned long) +
+                        BLOCK_REFS_SIZE * sizeof(unsigned long) +
+                        DATA_BLOCK_COUNT * sizeof(struct osfs_dedup_entry) +
                         INODE_COUNT * sizeof(struct osfs_inode) +
+                        PAGE_SIZE + // Slack for page-aligning the data blocks (mmap)
                         DATA_BLOCK_COUNT * BLOCK_SIZE;
 
     // Allocate memory for superblock information and related structures
@@ -66,31 +215,52 @@ int osfs_fill_super(struct super_block *sb, void *data, int silent)
     sb_info->block_size = BLOCK_SIZE;
     sb_info->inode_count = INODE_COUNT;
     sb_info->block_count = DATA_BLOCK_COUNT;
-    sb_info->nr_free_inodes = INODE_COUNT - 1;
+    sb_info->nr_free_inodes = INODE_COUNT - 2; // Inode 0 is never used, inode 1 is the root
     sb_info->nr_free_blocks = DATA_BLOCK_COUNT;
 
+    ret = osfs_parse_options(data, sb_info);
+    if (ret) {
+        vfree(memory_region);
+        return ret;
+    }
+
     // Partition the memory region into respective components
     sb_info->inode_bitmap = (unsigned long *)(sb_info + 1);
     sb_info->block_bitmap = sb_info->inode_bitmap + INODE_BITMAP_SIZE;
-    sb_info->inode_table = (void *)(sb_info->block_bitmap + BLOCK_BITMAP_SIZE);
-    sb_info->data_blocks = (void *)((char *)sb_info->inode_table +
-                                    INODE_COUNT * sizeof(struct osfs_inode));
+    sb_info->block_refs = (uint16_t *)(sb_info->block_bitmap + BLOCK_BITMAP_SIZE);
+    sb_info->dedup_entries = (void *)((unsigned long *)sb_info->block_refs + BLOCK_REFS_SIZE);
+    sb_info->inode_table = (void *)(sb_info->dedup_entries + DATA_BLOCK_COUNT);
+    // Data blocks start on a page boundary so that each block is exactly one
+    // page, which osfs_mmap maps straight into user space.
+    sb_info->data_blocks = PTR_ALIGN((void *)((char *)sb_info->inode_table +
+                                              INODE_COUNT * sizeof(struct osfs_inode)),
+                                     PAGE_SIZE);
 
     // Initialize bitmaps
     memset(sb_info->inode_bitmap, 0, INODE_BITMAP_SIZE * sizeof(unsigned long));
+    spin_lock_init(&sb_info->inode_bitmap_lock);
     memset(sb_info->block_bitmap, 0, BLOCK_BITMAP_SIZE * sizeof(unsigned long));
+    memset(sb_info->block_refs, 0, BLOCK_REFS_SIZE * sizeof(unsigned long));
+    hash_init(sb_info->dedup_table); // dedup_entries 已被 memset 成 0，即「不在 table 中」
+    spin_lock_init(&sb_info->block_lock);
 
     // Set superblock fields
+    // From here on osfs_kill_superblock owns memory_region, so the error paths
+    // below must not vfree it themselves.
     sb->s_magic = sb_info->magic;
+    sb->s_blocksize = BLOCK_SIZE;
+    sb->s_blocksize_bits = ilog2(BLOCK_SIZE);
+    // bitmap engine 的檔案最多 MAX_EXTENTS 個區塊；VFS 會據此擋下過大的 write/truncate
+    if (sb_info->engine == OSFS_ENGINE_BITMAP)
+        sb->s_maxbytes = (loff_t)MAX_EXTENTS * BLOCK_SIZE;
     sb->s_fs_info = sb_info;
     sb->s_op = &osfs_super_ops;
+    sb->s_max_links = U16_MAX; // osfs_inode.i_links_count is 16 bits
 
     // Create root directory inode
     root_inode = new_inode(sb);
-    if (!root_inode) {
-        vfree(memory_region);
+    if (!root_inode)
         return -ENOMEM;
-    }
 
     root_inode->i_ino = ROOT_INODE;
     root_inode->i_sb = sb;
@@ -98,16 +268,17 @@ int osfs_fill_super(struct super_block *sb, void *data, int silent)
     root_inode->i_fop = &osfs_dir_operations;
     root_inode->i_mode = S_IFDIR | 0755;
     set_nlink(root_inode, 2);
+    insert_inode_hash(root_inode); // 讓 osfs_iget 找得到同一個 inode
     simple_inode_init_ts(root_inode);
     
     // Initialize root directory's osfs_inode
     struct osfs_inode *root_osfs_inode = osfs_get_osfs_inode(sb, ROOT_INODE);
     if (!root_osfs_inode) {
         iput(root_inode);
-        vfree(memory_region);
         return -EIO;
     }
     memset(root_osfs_inode, 0, sizeof(*root_osfs_inode));
+    seqlock_init(&root_osfs_inode->i_meta_lock);
 
     root_osfs_inode->i_ino = ROOT_INODE;
     root_osfs_inode->i_mode = root_inode->i_mode;
@@ -124,11 +295,11 @@ int osfs_fill_super(struct super_block *sb, void *data, int silent)
     ret = osfs_alloc_data_block(sb_info, &root_block);
     if (ret) {
         iput(root_inode);
-        vfree(memory_region);
         return ret;
     }
 
     // Bonus: 將分配到的 Block 號碼存入陣列的第一個位置
+    // (第一個分配，所以一定是 block 0 = OSFS_HOLE，檔案永遠不會用到它)
     root_osfs_inode->i_blocks_array[0] = root_block;
     root_osfs_inode->i_blocks = 1;
     root_inode->i_blocks = 1;
@@ -137,12 +308,9 @@ int osfs_fill_super(struct super_block *sb, void *data, int silent)
     root_inode->i_size = 0;
     inode_init_owner(&nop_mnt_idmap, root_inode, NULL, root_inode->i_mode);
     // Set the root directory
-    sb->s_root = d_make_root(root_inode);
-    if (!sb->s_root) {
-        iput(root_inode);
-        vfree(memory_region);
+    sb->s_root = d_make_root(root_inode); // Drops root_inode itself on failure
+    if (!sb->s_root)
         return -ENOMEM;
-    }
     pr_info("osfs: Superblock filled successfully \n");
     return 0;
 }
\ No newline at end of file